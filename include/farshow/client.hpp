@@ -4,9 +4,55 @@
 #include <GL/glew.h> //GLuint
 #include <GLFW/glfw3.h>
 
+/// Number of pixel buffers used in turns to upload frames of a window, so an upload doesn't wait for the previous one
+#define PBO_COUNT 3
+/// Number of the latest durations kept for the frame-time graphs
+#define TIME_SAMPLES 120
+
 namespace farshow
 {
 
+/**
+ * Latest durations (e.g. times between displayed frames) for a graph and their mean and maximum
+ */
+class TimeSeries
+{
+public:
+    /**
+     * Adds a duration, in place of the oldest one
+     *
+     * @param ms Duration in milliseconds
+     */
+    void add(float ms);
+
+    /**
+     * Returns the mean of the kept durations
+     *
+     * @returns Mean duration in milliseconds, 0 if there are none
+     */
+    float mean() const;
+
+    /**
+     * Returns the longest of the kept durations
+     *
+     * @returns Longest duration in milliseconds, 0 if there are none
+     */
+    float max() const;
+
+    /**
+     * Draws the durations as a Dear ImGui line graph, from the oldest one
+     *
+     * @param label Label of the graph (hidden after ##)
+     * @param size Size of the graph
+     */
+    void plot(const char *label, ImVec2 size) const;
+
+private:
+    float samples[TIME_SAMPLES] = {0}; ///< durations in milliseconds, a ring starting at `next` once it's full
+    int next = 0;                      ///< index of the next duration
+    int count = 0;                     ///< number of kept durations
+};
+
 /**
  * Class for handling displaying frames and loading their textures
  */
@@ -23,7 +69,16 @@ public:
      *
      * @param frame Frame structure – source of the name and image
      */
-    FrameWindow(Frame &frame) : name(frame.name), changed(true), texture(-1) { changeImg(frame.img); }
+    FrameWindow(Frame &frame) : name(frame.name), changed(true), texture(-1) { changeFrame(frame); }
+
+    /**
+     * Replaces img with the frame's image (in any of the pixel formats) and updates the frame interval
+     *
+     * Like `changeImg`, it can be launched from different thread.
+     *
+     * @param frame Received frame
+     */
+    void changeFrame(Frame &frame);
 
     /**
      * Replaces img and marks it as changed
@@ -31,8 +86,8 @@ public:
      * The method can be launched from different thread, so the reloadTexture function is not used. You have to run it
      * manually from the main thread.
      *
-     * If the image has 1 channel it's assumed to be grayscale (and it's converted to BGR), otherwise it's treated like
-     * BGR.
+     * Images with 1 channel are assumed to be grayscale, with 2 channels grayscale with alpha, with 3 channels BGR and
+     * with 4 channels BGRA. They can have 8-bit, 16-bit or float channels.
      *
      * @param new_image New image
      */
@@ -40,30 +95,112 @@ public:
 
     /**
      * Reloads the texture from the img. Creates a texture handler if it's not present.
-     * Image should be in BGR format.
+     *
+     * The pixels are uploaded as they are, in a texture of matching format – gray images are expanded to gray RGB by
+     * the GPU. YUV planes of I420 images are uploaded to their own textures and converted to RGB by a shader.
+     *
+     * The image is copied to the next pixel buffer of the ring and the texture is updated from it, so the transfer to
+     * the GPU runs asynchronously. The texture storage is allocated again only when the image size changes.
      *
      * Has to be run from the same thread as `glfwInit` (the main one)
      */
     void reloadTexture();
 
     /**
-     * Prepares Dear ImGui window with the image
+     * Prepares Dear ImGui window with the image. The texture is reloaded only if the window is visible.
+     *
+     * @param open If given, the window has a close button, which sets it to false
+     */
+    void display(bool *open = nullptr);
+
+    /**
+     * Tells if the window was visible in the last `display` – not collapsed and not outside of the screen
+     *
+     * @returns True if the window is visible
      */
-    void display();
+    bool isVisible() { return visible; }
+
+    /**
+     * Updates the reception statistics shown in the performance overlay – received frame rate, and the lost parts and
+     * incomplete frames since the previous update
+     *
+     * @param stats Counters of the window's stream
+     */
+    void updateStats(const ReceiverStreamSnapshot &stats);
+
+    /**
+     * Shows or hides the performance overlay (which can also be toggled from the window's context menu)
+     *
+     * @param shown If the overlay should be shown
+     */
+    void showOverlay(bool shown) { overlay = shown; }
 
     ~FrameWindow();
 
 private:
-    GLuint texture = -1;  ///< OpenGL texture identifier
-    std::string name;     ///< Window name
-    cv::Mat img;          ///< Image to display
-    bool changed = false; ///< If the img has changed since last texture reload
-    struct WindowData     ///< Window options
+    GLuint texture = -1;                              ///< OpenGL texture identifier
+    int texture_width = 0;                            ///< Width of the allocated texture storage
+    int texture_height = 0;                           ///< Height of the allocated texture storage
+    int texture_type = -1;                            ///< OpenCV type of the image in the allocated texture storage
+    PixelFormat texture_format = PixelFormat::NATIVE; ///< Pixel format of the image in the allocated texture storage
+    GLuint planes[3] = {0};                           ///< Textures of the Y, U and V planes of I420 images
+    GLuint framebuffer = 0;                           ///< Framebuffer converting the planes to `texture`
+    GLuint pbos[PBO_COUNT] = {0};                     ///< Pixel buffers for uploading the images
+    unsigned next_pbo = 0;                            ///< Pixel buffer for the next upload
+    std::string name;                                 ///< Window name
+    cv::Mat img;                                      ///< Image to display
+    PixelFormat format = PixelFormat::NATIVE;         ///< Layout of the pixels in img
+    bool changed = false;                             ///< If the img has changed since last texture reload
+    bool visible = true;                              ///< If the window was visible in the last `display`
+    std::chrono::system_clock::time_point captured;   ///< When the sender captured img
+    std::chrono::system_clock::time_point previous;   ///< When the sender captured the previous image
+    float latency = 0;                                ///< Time from capturing an image to loading its texture in ms
+                                                      ///< (moving average)
+    float interval = 0;                               ///< Time between captures of consecutive images in ms (moving
+                                                      ///< average)
+    float decode_time = 0;                            ///< Time of decoding an image in ms (moving average)
+    float upload_time = 0;                            ///< Time of `reloadTexture` in ms (moving average)
+    TimeSeries frame_times;                           ///< Times between texture reloads in ms
+    std::chrono::steady_clock::time_point reloaded;   ///< When the texture was last reloaded
+    bool overlay = false;                             ///< If the performance overlay is shown
+    ReceiverStreamSnapshot stats;                     ///< Counters of the stream at the last `updateStats`
+    float loss = 0;                                   ///< Percentage of parts lost between the last two updates
+    uint64_t incomplete_frames = 0;                   ///< Frames dropped or evicted between the last two updates
+    uint64_t missing_frames = 0;                      ///< Frames with no part received between the last two updates
+    struct WindowData                                 ///< Window options
     {
         float aspect_ratio;
         ImVec2 offset;
     };
 
+    /**
+     * Returns the size of the image (of its Y plane for I420 images)
+     *
+     * @returns Image size
+     */
+    cv::Size imageSize() { return cv::Size(img.cols, format == PixelFormat::I420 ? img.rows * 2 / 3 : img.rows); }
+
+    /**
+     * Copies img to the next pixel buffer of the ring and leaves the buffer bound
+     *
+     * @returns True if the image was copied
+     */
+    bool fillPixelBuffer();
+
+    /**
+     * Updates the plane textures from the bound pixel buffer with an I420 image, and converts them to RGB in `texture`
+     *
+     * @param size Size of the image
+     */
+    void convertPlanes(cv::Size size);
+
+    /**
+     * Draws the performance overlay in the top left corner of the image
+     *
+     * @param corner Position of the image's top left corner on the screen
+     */
+    void displayOverlay(ImVec2 corner);
+
     /**
      * Resizes the window with given aspect ratio.
      *
@@ -83,10 +220,11 @@ void initGui();
  * Creates window with the size of the screen
  *
  * @param name Window name
+ * @param vsync If buffer swaps wait for the display refresh (turning it off lowers latency, but may cause tearing)
  *
  * @returns window
  */
-GLFWwindow *createWindow(std::string name);
+GLFWwindow *createWindow(std::string name, bool vsync = true);
 
 /**
  * Sets context and backend for Dear ImGui
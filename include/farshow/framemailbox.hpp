@@ -0,0 +1,93 @@
+#pragma once
+#include "farshow/framereceiver.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace farshow
+{
+
+/**
+ * Mailbox passing frames from the receiving thread to a consumer
+ *
+ * Putting a frame never waits for the consumer – when the mailbox is full, the oldest frame is dropped. That way a slow
+ * consumer always gets the freshest frames and never slows down the network thread.
+ */
+class FrameMailbox
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param mode Delivery mode
+     * @param capacity Maximum number of queued frames (used only in DeliveryMode::QUEUE, LATEST always keeps one frame)
+     */
+    FrameMailbox(DeliveryMode mode = DeliveryMode::LATEST, size_t capacity = 1);
+
+    /**
+     * Places the frame in the mailbox. Never blocks.
+     *
+     * @param frame Frame to deliver
+     */
+    void put(Frame frame);
+
+    /**
+     * Takes the oldest frame from the mailbox, if there is any
+     *
+     * @param frame Place for the taken frame
+     *
+     * @returns True if the frame was taken, false if the mailbox is empty
+     */
+    bool tryTake(Frame &frame);
+
+    /**
+     * Waits for a frame and takes it from the mailbox
+     *
+     * @param frame Place for the taken frame
+     *
+     * @returns True if the frame was taken, false if the mailbox was closed and there are no frames left
+     */
+    bool take(Frame &frame);
+
+    /**
+     * Waits for a frame (no longer than timeout) and takes it from the mailbox
+     *
+     * @param frame Place for the taken frame
+     * @param timeout Maximum waiting time
+     *
+     * @returns True if the frame was taken, false on timeout or if the mailbox was closed and there are no frames left
+     */
+    bool take(Frame &frame, std::chrono::milliseconds timeout);
+
+    /**
+     * Closes the mailbox and wakes up all waiting consumers. Frames put in the mailbox before can still be taken.
+     */
+    void close();
+
+    /**
+     * Tells if the mailbox was closed
+     *
+     * @returns True if the mailbox was closed
+     */
+    bool isClosed();
+
+    /**
+     * Returns number of frames dropped because the consumer didn't take them in time
+     *
+     * @returns Number of dropped frames
+     */
+    unsigned long getDropped();
+
+private:
+    DeliveryMode mode;                 ///< delivery mode
+    size_t capacity;                   ///< maximum number of queued frames
+    std::deque<Frame> frames;          ///< frames waiting for the consumer
+    std::mutex mutex;                  ///< guards all the fields, the critical sections never wait for the consumer
+    std::condition_variable available; ///< notified when a frame is put or the mailbox is closed
+    unsigned long dropped = 0;         ///< number of overwritten frames
+    bool closed = false;               ///< if the mailbox was closed
+};
+
+}; // namespace farshow
@@ -1,22 +1,161 @@
 #pragma once
+#include "farshow/stats.hpp"
 #include "farshow/udpinterface.hpp"
 
 #include "opencv2/core/mat.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace farshow
 {
 
+/**
+ * Moments on the way of a frame through the receiver
+ */
+struct FrameTimestamps
+{
+    std::chrono::system_clock::time_point captured;    ///< when the sender captured the frame (sender's clock)
+    std::chrono::system_clock::time_point encoded;     ///< when the sender encoded the frame (sender's clock)
+    std::chrono::system_clock::time_point first_part;  ///< when the first part of the frame arrived
+    std::chrono::system_clock::time_point last_part;   ///< when the last part of the frame arrived
+    std::chrono::system_clock::time_point reassembled; ///< when all parts were joined
+    std::chrono::system_clock::time_point decoded;     ///< when the frame was decoded
+};
+
+/**
+ * Layout of the pixels of a decoded frame
+ */
+enum class PixelFormat
+{
+    NATIVE, ///< As returned by cv::imdecode – gray, BGR or BGRA
+    I420    ///< Planar YUV 4:2:0 in one CV_8UC1 image of 3/2 of the frame's height – the Y plane, followed by the U
+            ///< and V planes of half the width and height
+};
+
 /**
  * Complete frame, ready for return
  */
 typedef struct Frame
 {
-    std::string name; ///< name of the stream
-    cv::Mat img;      ///< image
+    std::string name;                         ///< name of the stream
+    cv::Mat img;                              ///< image
+    FrameTimestamps timestamps;               ///< times of capture, encoding (from the sender), arrival (from the
+                                              ///< kernel), reassembly and decoding
+    PixelFormat format = PixelFormat::NATIVE; ///< layout of the pixels in `img`
 } Frame;
 
+/**
+ * Function called with every received frame of a subscribed stream
+ */
+typedef std::function<void(Frame &)> FrameCallback;
+
+/**
+ * Complete frame before decoding. Points to data owned by the receiver (or a recording), valid only during the call it
+ * is passed to.
+ */
+struct EncodedFrame
+{
+    std::string_view name;      ///< name of the stream
+    unsigned id;                ///< frame id given by the sender
+    const uchar *data;          ///< encoded image
+    size_t size;                ///< size of the encoded image
+    FrameTimestamps timestamps; ///< times of capture, encoding, arrival and reassembly (`decoded` isn't set)
+};
+
+/**
+ * Function called with every complete frame of a subscribed stream, before it's decoded
+ */
+typedef std::function<void(const EncodedFrame &)> EncodedFrameCallback;
+
+/**
+ * Function decoding complete frames instead of cv::imdecode. It sets `img` (and `format`) of the frame and returns
+ * true, or returns false to let cv::imdecode decode the frame.
+ */
+typedef std::function<bool(const EncodedFrame &, Frame &)> FrameDecoder;
+
+/**
+ * How frames are delivered to a stream subscriber
+ */
+enum class DeliveryMode
+{
+    LATEST, ///< Keep only the most recent frame, overwrite it if the consumer didn't take it yet
+    QUEUE   ///< Keep frames in order in a bounded queue, drop the oldest one when the queue is full
+};
+
+class FrameMailbox;
+
+/**
+ * How the stream filter treats the listed streams
+ */
+enum class FilterMode
+{
+    ALLOW, ///< Receive only the listed streams
+    DENY   ///< Receive all streams except the listed ones
+};
+
+/**
+ * Hash for looking up std::string keys with std::string_view, without creating temporary strings
+ */
+struct StringHash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view text) const { return std::hash<std::string_view>{}(text); }
+};
+
+/**
+ * Set of strings, which can be searched with std::string_view
+ */
+typedef std::unordered_set<std::string, StringHash, std::equal_to<>> StringSet;
+
+/**
+ * Limits of memory used for reassembling incomplete frames
+ */
+struct ReassemblyLimits
+{
+    size_t max_stream_bytes = 64 << 20;            ///< Maximum size of incomplete frames of a single stream. When it's
+                                                   ///< exceeded, the oldest frames of the stream are evicted.
+    size_t max_total_bytes = 256 << 20;            ///< Maximum size of incomplete and kept frames of all streams.
+                                                   ///< When it's exceeded, the kept frames of hidden streams are
+                                                   ///< evicted, then the oldest frames of the least recently updated
+                                                   ///< streams.
+    std::chrono::milliseconds max_frame_age{2000}; ///< Incomplete frames without new parts for this long are evicted
+    size_t max_streams = 256;                      ///< Maximum number of tracked streams. Least recently updated
+                                                   ///< streams are forgotten.
+    size_t max_receive_buffer = 64 << 20;          ///< Maximum size of the socket receive buffer, which grows with
+                                                   ///< the frames and kernel drops (0 keeps the system default)
+};
+
+/**
+ * Counters of the reassembly memory
+ */
+struct ReassemblyStats
+{
+    unsigned long evicted_frames;  ///< Number of incomplete or kept frames evicted (or dropped, because they don't
+                                   ///< fit the budget)
+    unsigned long evicted_bytes;   ///< Size of evicted frames
+    unsigned long evicted_streams; ///< Number of streams forgotten to make place for new ones
+    size_t used_bytes;             ///< Size of currently reassembled and kept frames
+    unsigned long duplicate_parts; ///< Number of parts received more than once (or late parts of delivered frames)
+    unsigned long invalid_parts;   ///< Number of parts with part_id out of range
+    unsigned long dropped_frames;  ///< Number of frames dropped before receiving all their parts
+    unsigned long lost_parts;      ///< Number of parts missing in the dropped frames (lost in the network or
+                                   ///< dropped by the kernel)
+    unsigned long kernel_drops;    ///< Number of datagrams dropped by the kernel, because the socket receive buffer was
+                                   ///< full – when it grows, the receiver doesn't keep up
+    size_t receive_buffer;         ///< Current size of the socket receive buffer
+};
+
 /**
  * Container for a received frame
  */
@@ -28,15 +167,52 @@ public:
      *
      * @param id frame id
      * @param total_parts number of parts we're waiting for
-     * @param name stream to which the frame belongs
      * @param frame_size Total size of the image
+     * @param part_size Size of the image data in a part (all parts but the last one)
      */
-    FrameContainer(unsigned id, unsigned total_parts, std::string name, unsigned frame_size)
-        : id(id), total_parts(total_parts), added_parts(0), name(name)
+    FrameContainer(unsigned id, unsigned total_parts, unsigned frame_size, unsigned part_size = 0)
+        : id(id), total_parts(total_parts), added_parts(0), part_size(part_size),
+          received_parts((total_parts + 63) / 64, 0)
     {
         img = std::vector<uchar>(frame_size);
     }
 
+    /**
+     * Marks the part as received
+     *
+     * @param part_id Part id
+     *
+     * @returns True if it's a new part of the frame, false if the part was already received or it's out of range
+     */
+    bool markPart(unsigned part_id)
+    {
+        if (part_id >= total_parts)
+        {
+            return false;
+        }
+        uint64_t &word = received_parts[part_id / 64];
+        uint64_t bit = uint64_t(1) << (part_id % 64);
+        if (word & bit)
+        {
+            return false;
+        }
+        word |= bit;
+        added_parts++;
+        return true;
+    }
+
+    /**
+     * Tells if the part was already received
+     *
+     * @param part_id Part id
+     *
+     * @returns True if the part was received
+     */
+    bool hasPart(unsigned part_id)
+    {
+        return part_id < total_parts && (received_parts[part_id / 64] & (uint64_t(1) << (part_id % 64)));
+    }
+
     /**
      * Tells if the frame has all parts.
      *
@@ -44,11 +220,18 @@ public:
      */
     bool isComplete() { return total_parts == added_parts; }
 
-    unsigned id;            ///< frame id
-    unsigned total_parts;   ///< number of parts which we're waiting for
-    unsigned added_parts;   ///< number of received parts
-    std::vector<uchar> img; ///< the frame data
-    std::string name;       ///< stream to which the frame belongs
+    unsigned id;                                       ///< frame id
+    unsigned total_parts;                              ///< number of parts which we're waiting for
+    unsigned added_parts;                              ///< number of distinct received parts
+    unsigned part_size;                                ///< size of the image data in a part, given by the first part
+    std::vector<uchar> img;                            ///< the frame data
+    std::chrono::steady_clock::time_point last_update; ///< when the last part of the frame was received
+    std::vector<uint64_t> received_parts;              ///< bitmap of received parts, bit `part_id` is set when the
+                                                       ///< part arrives
+    std::chrono::system_clock::time_point first_part;  ///< when the first part arrived (kernel timestamp)
+    std::chrono::system_clock::time_point last_part;   ///< when the latest part arrived (kernel timestamp)
+    uint64_t capture_time = 0;                         ///< capture time from the header
+    uint64_t encode_time = 0;                          ///< encode time from the header
 };
 
 /**
@@ -62,8 +245,11 @@ public:
      *
      * @param client_port Client's port
      * @param client_address Client's ip address (if not provided, binds the socket to all available interfaces)
+     * @param limits Limits of memory used for reassembling frames
+     * @param reuse_port If the socket should be bound with SO_REUSEPORT, so several receivers can share the port
      */
-    FrameReceiver(std::string client_address = "", int client_port = 1100);
+    FrameReceiver(std::string client_address = "", int client_port = 1100,
+                  ReassemblyLimits limits = ReassemblyLimits(), bool reuse_port = false);
 
     /**
      * Receives and displays the frame
@@ -79,36 +265,470 @@ public:
      */
     int getSocket() { return mySocket; }
 
+    /**
+     * Changes the limits of memory used for reassembling frames. Should be called from the receiving thread or before
+     * receiving starts.
+     *
+     * @param limits New limits
+     */
+    void setReassemblyLimits(ReassemblyLimits limits);
+
+    /**
+     * Sets the function decoding the frames instead of cv::imdecode (e.g. to a different pixel format). Should be
+     * called before receiving starts.
+     *
+     * @param decoder Decoding function, empty to decode all frames with cv::imdecode
+     */
+    void setDecoder(FrameDecoder decoder) { this->decoder = decoder; }
+
+    /**
+     * Returns counters of the reassembly memory. Can be called from any thread.
+     *
+     * @returns Reassembly counters
+     */
+    ReassemblyStats getReassemblyStats();
+
+    /**
+     * Returns counters of every stream seen so far (also of streams, which were already forgotten). Can be called from
+     * any thread – the receiving thread updates the counters without locking.
+     *
+     * @returns Counters mapped to stream names
+     */
+    std::unordered_map<std::string, ReceiverStreamSnapshot> getStreamStats() { return stream_stats.snapshot(); }
+
+    /**
+     * Sets which streams should be received. Can be changed at any time, also from other threads.
+     *
+     * Packets of filtered out streams are dropped right after reading their header, before they're copied or
+     * reassembled.
+     *
+     * @param mode Whether to receive only the listed streams, or all streams except them
+     * @param names Stream names
+     */
+    void setStreamFilter(FilterMode mode, std::vector<std::string> names);
+
+    /**
+     * Removes the stream filter, so all streams are received
+     */
+    void clearStreamFilter();
+
+    /**
+     * Sets if frames of the stream are decoded (e.g. if its window is visible). Can be changed at any time, also from
+     * other threads. All streams are visible by default.
+     *
+     * Frames of a hidden stream are still reassembled and passed to the subscribers of encoded frames, but they aren't
+     * decoded, returned by `receiveFrame` or delivered to the frame subscribers. Only the newest one is kept, encoded.
+     *
+     * @param name Stream name
+     * @param visible If the stream should be decoded
+     *
+     * @returns The newest frame kept while the stream was hidden, when it becomes visible again. It's decoded in the
+     * calling thread, so the decoder set with `setDecoder` has to be thread-safe.
+     */
+    std::optional<Frame> setStreamVisible(const std::string &name, bool visible);
+
+    /**
+     * Limits how many frames of the stream are decoded per second (e.g. to the display refresh rate). Can be changed at
+     * any time, also from other threads.
+     *
+     * Frames of the stream are still all reassembled and passed to the subscribers of encoded frames. A frame completed
+     * sooner than 1/rate after the last decoded one is kept encoded, replacing the previously kept one, and only the
+     * newest kept frame is decoded when its turn comes (waiting for the next part ends then).
+     *
+     * @param name Stream name (empty name sets the limit of streams without their own one)
+     * @param rate Maximum number of decoded frames per second, 0 for no limit
+     */
+    void setMaxDecodeRate(const std::string &name, float rate);
+
+    /**
+     * Registers a callback for frames from the stream
+     *
+     * The callback is run from the thread running `run`, so it should return quickly. It must not call `subscribe` or
+     * `unsubscribe`.
+     *
+     * @param name Stream name (empty name subscribes to all streams)
+     * @param callback Function called with every frame from the stream
+     */
+    void subscribe(std::string name, FrameCallback callback);
+
+    /**
+     * Creates a mailbox for frames from the stream
+     *
+     * @param name Stream name (empty name subscribes to all streams)
+     * @param mode Delivery mode – keep only the latest frame or keep frames in a bounded queue
+     * @param capacity Maximum number of queued frames in DeliveryMode::QUEUE
+     *
+     * @returns Mailbox from which the consumer takes frames. It's closed when `run` finishes.
+     */
+    std::shared_ptr<FrameMailbox> subscribe(std::string name, DeliveryMode mode = DeliveryMode::LATEST,
+                                            size_t capacity = 1);
+
+    /**
+     * Subscribes an existing mailbox to frames from the stream. The same mailbox can be subscribed to many streams or
+     * receivers.
+     *
+     * @param name Stream name (empty name subscribes to all streams)
+     * @param mailbox Mailbox to put the frames in. It's closed when `run` finishes.
+     */
+    void subscribe(std::string name, std::shared_ptr<FrameMailbox> mailbox);
+
+    /**
+     * Registers a callback for encoded frames from the stream, called with every complete frame before it's decoded
+     * (e.g. to record the stream without re-encoding it).
+     *
+     * The callback is run from the thread receiving frames (`run` or `receiveFrame`), so it should return quickly. It
+     * must not call `subscribe` or `unsubscribe`.
+     *
+     * @param name Stream name (empty name subscribes to all streams)
+     * @param callback Function called with every encoded frame from the stream
+     */
+    void subscribeEncoded(std::string name, EncodedFrameCallback callback);
+
+    /**
+     * Removes all callbacks and mailboxes subscribed to the stream. Removed mailboxes are closed.
+     *
+     * @param name Stream name
+     * @param kept Mailbox, which stays subscribed and open (e.g. one shared with other receivers)
+     */
+    void unsubscribe(std::string name, std::shared_ptr<FrameMailbox> kept = nullptr);
+
+    /**
+     * Receives frames and delivers them to the subscribers, until the socket is shut down.
+     *
+     * Frames from streams without subscribers are dropped. Frames are decoded only for streams with callbacks or
+     * mailboxes – streams with only subscribers of encoded frames are never decoded.
+     */
+    void run();
+
 private:
     /**
-     * Receives a message with a frame part
+     * Complete frame kept encoded – the newest one of a hidden stream, or one waiting to be decoded
+     */
+    struct HeldFrame
+    {
+        std::vector<uchar> data;    ///< encoded image
+        unsigned id;                ///< frame id given by the sender
+        FrameTimestamps timestamps; ///< times of capture, encoding, arrival and reassembly
+    };
+
+    /**
+     * Incomplete frames of a stream
+     */
+    struct Stream
+    {
+        std::list<FrameContainer> frames;                    ///< incomplete frames, sorted by id
+        size_t bytes;                                        ///< size of the frames
+        std::chrono::steady_clock::time_point last_update;   ///< when the last part of any frame was received
+        bool delivered_any;                                  ///< if any frame of the stream was completed
+        unsigned last_delivered;                             ///< id of the last completed frame
+        uint64_t last_captured;                              ///< capture time of the last completed frame
+        bool started_any;                                    ///< if any frame of the stream was started
+        unsigned last_started;                               ///< highest id of a started frame
+        std::shared_ptr<ReceiverStreamStats> stats;          ///< counters of the stream
+        size_t frame_bytes;                                  ///< size of the datagrams of the last started frame
+        std::chrono::steady_clock::duration decode_interval; ///< shortest time between decoded frames (0 if unlimited)
+        unsigned rates_version;                              ///< `decode_rates_version` of `decode_interval`
+        std::chrono::steady_clock::time_point last_decode;   ///< when the last frame was decoded
+        std::optional<HeldFrame> held;                       ///< newest complete frame waiting to be decoded
+    };
+
+    /**
+     * Subscriber of a stream – either a callback or a mailbox
+     */
+    struct Subscriber
+    {
+        FrameCallback callback;                ///< function called with the frame (if there is no mailbox)
+        std::shared_ptr<FrameMailbox> mailbox; ///< mailbox to put the frame in
+    };
+
+    /**
+     * Delivers the frame to all subscribers of its stream
      *
-     * @returns Received message with a frame part
+     * @param frame Frame to deliver
      */
-    FrameMessage receiveFramePart();
+    void deliver(Frame &frame);
 
     /**
-     * Deletes incomplete frames before this frame, and decodes the frame
+     * Passes the encoded frame to all subscribers of encoded frames of its stream
      *
-     * @param frame Iterator to the complete frame
+     * @param frame Frame to deliver
+     */
+    void deliverEncoded(const EncodedFrame &frame);
+
+    /**
+     * Counts frames skipped in the ids of started frames as missing – no part of them has arrived (yet)
+     *
+     * @param stream Stream of the frame
+     * @param id Id of the started frame
+     */
+    void countMissingFrames(Stream &stream, unsigned id);
+
+    /**
+     * Receives a message with a frame part and points `message` to it
+     *
+     * @param deadline Time after which waiting for the message is given up
+     *
+     * @returns Size of the received message, nothing if the deadline has passed
+     */
+    std::optional<size_t> receiveFramePart(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * Reads the stream name from the message
+     *
+     * @param msg Message with a frame part
+     *
+     * @returns Stream name (without the terminating null character), empty if the header is malformed
+     */
+    static std::string_view getStreamName(const FrameMessage &msg);
+
+    /**
+     * Checks the stream name against the stream filter. The filter is copied only when it changes, so the check doesn't
+     * lock.
+     *
+     * @param name Stream name
+     *
+     * @returns True if the stream should be received
+     */
+    bool isAccepted(std::string_view name);
+
+    /**
+     * Keeps a copy of the complete frame if its stream is hidden, replacing the previously kept one
+     *
+     * @param name Stream name
+     * @param frame Complete frame
+     *
+     * @returns True if the stream is hidden
+     */
+    bool holdIfHidden(std::string_view name, const FrameContainer &frame);
+
+    /**
+     * Copies the complete frame with its timestamps and counts it in the reassembly memory
+     *
+     * @param frame Complete frame
+     * @param held Where to copy the frame
+     */
+    void copyFrame(const FrameContainer &frame, HeldFrame &held);
+
+    /**
+     * Decodes the frame with the decoder, or with cv::imdecode if there's none or it refused to, and sets the time of
+     * decoding
+     *
+     * @param encoded Encoded frame
+     * @param result Frame to set the image in
+     */
+    void decodeFrame(const EncodedFrame &encoded, Frame &result);
+
+    /**
+     * Decodes the kept frame
+     *
+     * @param name Stream name
+     * @param held Kept frame
      *
      * @returns Decoded frame
      */
-    cv::Mat prepareToShow(std::list<FrameContainer>::iterator frame);
+    Frame decodeHeld(const std::string &name, const HeldFrame &held);
+
+    /**
+     * Tells if it's too soon to decode a frame of the stream, because of its decode rate limit
+     *
+     * @param stream Stream
+     * @param name Stream name
+     * @param now Current time
+     *
+     * @returns True if the frame should be kept for later
+     */
+    bool isThrottled(Stream &stream, std::string_view name, std::chrono::steady_clock::time_point now);
+
+    /**
+     * Decodes a kept frame of any stream, whose decode rate limit allows it
+     *
+     * @param now Current time
+     *
+     * @returns Decoded frame, nothing if no kept frame is due
+     */
+    std::optional<Frame> decodeDueFrame(std::chrono::steady_clock::time_point now);
 
     /**
-     * Assigns the frame part to a proper frame in a proper stream
+     * Checks if the part can be added to a frame – if its id is in range and the frame fits the memory budget
      *
+     * @param frame_part Frame part to check
+     * @param size Size of the received message
+     *
+     * @returns True if the part is valid
+     */
+    bool isValid(const FrameMessage &frame_part, size_t size);
+
+    /**
+     * Deletes incomplete frames before this frame, passes it to the subscribers of encoded frames and decodes it
+     *
+     * @param name Name of the stream
+     * @param stream Stream to which the frame belongs
+     * @param frame Iterator to the complete frame
+     * @param decode If the frame should be decoded
+     *
+     * @returns Frame with its timestamps, with an empty image if it wasn't decoded
+     */
+    Frame prepareToShow(std::string_view name, Stream &stream, std::list<FrameContainer>::iterator frame, bool decode);
+
+    /**
+     * Receives parts until any frame is complete
+     *
+     * @param decode_all If all frames should be decoded, otherwise only frames of streams with subscribers of decoded
+     * frames are decoded
+     *
+     * @returns Complete frame, empty frame if the socket was shut down
+     */
+    Frame receiveCompleteFrame(bool decode_all);
+
+    /**
+     * Tells if anyone is subscribed to decoded frames of the stream
+     *
+     * @param name Stream name
+     *
+     * @returns True if there's a callback or mailbox for the stream (or for all streams)
+     */
+    bool hasFrameSubscribers(std::string_view name);
+
+    /**
+     * Assigns the frame part to a proper frame in the stream
+     *
+     * @param stream Stream to which the part belongs
      * @param frame_part Frame part to add
+     * @param size Size of the received message
+     * @param now Current time
+     *
+     * @returns Iterator to the place there the frame was added, nothing if the part was dropped
+     */
+    std::optional<std::list<FrameContainer>::iterator> addPart(Stream &stream, const FrameMessage &frame_part,
+                                                               size_t size, std::chrono::steady_clock::time_point now);
+
+    /**
+     * Finds the stream, creates it if it's new. Forgets the least recently updated stream if there are too many.
+     *
+     * Doesn't create any string, unless the stream is new.
      *
-     * @returns Iterator to the place there the frame was added
+     * @param name Stream name
+     * @param now Current time
+     *
+     * @returns The stream
+     */
+    Stream &getStream(std::string_view name, std::chrono::steady_clock::time_point now);
+
+    /**
+     * Deletes frames from the stream and updates the memory counters
+     *
+     * @param stream Stream with the frames
+     * @param first Iterator to the first deleted frame
+     * @param last Iterator after the last deleted frame
      */
-    std::list<FrameContainer>::iterator addPart(FrameMessage frame_part);
+    void eraseFrames(Stream &stream, std::list<FrameContainer>::iterator first,
+                     std::list<FrameContainer>::iterator last);
 
-    std::unordered_map<std::string, std::list<FrameContainer>> streams; ///< All available streams mapped to their
-                                                                        ///< incomplete frames. The frames are sorted by
-                                                                        ///< id.
+    /**
+     * Deletes the incomplete frame and counts it as evicted
+     *
+     * @param stream Stream with the frame
+     * @param frame Iterator to the frame
+     */
+    void evictFrame(Stream &stream, std::list<FrameContainer>::iterator frame);
+
+    /**
+     * Deletes the frame kept by the decode rate limit of the stream and counts it as evicted
+     *
+     * @param stream Stream with the kept frame
+     */
+    void evictHeld(Stream &stream);
+
+    /**
+     * Deletes a kept frame of a hidden stream and counts it as evicted
+     *
+     * @returns False if there's no such frame
+     */
+    bool evictHiddenFrame();
+
+    /**
+     * Evicts frames, which didn't receive any part for `max_frame_age`, and forgets idle streams
+     *
+     * @param now Current time
+     */
+    void evictStale(std::chrono::steady_clock::time_point now);
+
+    /**
+     * Grows the socket receive buffer, within `limits.max_receive_buffer`. Never shrinks it.
+     *
+     * @param size Wanted size
+     */
+    void growReceiveBuffer(size_t size);
+
+    /**
+     * Evicts frames until the memory fits the limits. Never evicts the frame which is currently being filled.
+     *
+     * @param current_stream Stream to which the last part was added
+     * @param current_frame Frame to which the last part was added
+     */
+    void enforceLimits(Stream &current_stream, std::list<FrameContainer>::iterator current_frame);
+
+    std::unordered_map<std::string, Stream, StringHash, std::equal_to<>> streams; ///< All available streams mapped to
+                                                                                  ///< their incomplete frames
+    Stream *cached_stream = nullptr; ///< Stream found by the last lookup (reset when any stream is erased)
+    std::string_view cached_name;    ///< Name of `cached_stream`, points to its key in `streams`
+
+    const FrameMessage *message = nullptr; ///< The last received message (valid until the next one is received)
+
+    ReassemblyLimits limits;                          ///< Limits of memory used for reassembling frames
+    FrameDecoder decoder;                             ///< Function decoding the frames instead of cv::imdecode
+    std::atomic<size_t> total_bytes = 0;              ///< Size of all incomplete and kept frames
+    std::atomic<unsigned long> evicted_frames = 0;    ///< Number of evicted frames
+    std::atomic<unsigned long> evicted_bytes = 0;     ///< Size of evicted frames
+    std::atomic<unsigned long> evicted_streams = 0;   ///< Number of forgotten streams
+    std::atomic<unsigned long> duplicate_parts = 0;   ///< Number of duplicated parts
+    std::atomic<unsigned long> invalid_parts = 0;     ///< Number of parts with part_id out of range
+    std::atomic<unsigned long> dropped_frames = 0;    ///< Number of frames dropped before they were complete
+    std::atomic<unsigned long> lost_parts = 0;        ///< Number of parts missing in dropped frames
+    std::atomic<unsigned long> kernel_drops = 0;      ///< Number of datagrams dropped by the kernel
+    std::atomic<size_t> receive_buffer = 0;           ///< Size of the socket receive buffer reported by the kernel
+    size_t requested_buffer = 0;                      ///< Size of the receive buffer requested the last time
+    size_t burst_bytes = 0;                           ///< Size of the last frames of all streams, which may come at
+                                                      ///< once
+    std::chrono::steady_clock::time_point last_sweep; ///< When stale frames were evicted for the last time
+    StatsRegistry<ReceiverStreamStats> stream_stats;  ///< Counters of all streams
     bool running = true; ///< If the socket is still open and the process should run
+
+    /**
+     * Stream filter
+     */
+    struct StreamFilter
+    {
+        bool enabled = false;                ///< If the stream filter is used
+        FilterMode mode = FilterMode::ALLOW; ///< Whether `names` are allowed or denied
+        StringSet names;                     ///< Streams listed in the filter
+        unsigned version = 0;                ///< `filter_version` of the copy used by the receiving thread
+    };
+
+    StreamFilter filter;                      ///< Filter set from any thread
+    std::atomic<unsigned> filter_version = 0; ///< Incremented with every change of `filter`
+    std::mutex filter_mutex;                  ///< Mutex for `filter`, which can be changed from other threads
+    StreamFilter used_filter;                 ///< Copy of `filter` checked by the receiving thread without locking
+
+    StringSet hidden_names;               ///< Streams, which aren't decoded
+    std::atomic<bool> has_hidden = false; ///< If `hidden_names` isn't empty (checked without lock)
+    /// Newest frames of the hidden streams mapped to stream names
+    std::unordered_map<std::string, HeldFrame, StringHash, std::equal_to<>> held_frames;
+    std::mutex hidden_mutex; ///< Mutex for `hidden_names` and `held_frames`, which can be changed from other threads
+
+    /// Maximum decode rates mapped to stream names (the empty name is the default)
+    std::unordered_map<std::string, float, StringHash, std::equal_to<>> decode_rates;
+    std::atomic<unsigned> decode_rates_version = 0; ///< Incremented with every change of `decode_rates`
+    std::mutex decode_rates_mutex;                  ///< Mutex for `decode_rates`, changed from other threads
+    /// Earliest time when a kept frame of any stream can be decoded
+    std::chrono::steady_clock::time_point next_held_due = std::chrono::steady_clock::time_point::max();
+
+    /// Subscribers mapped to stream names
+    std::unordered_map<std::string, std::vector<Subscriber>, StringHash, std::equal_to<>> subscribers;
+    /// Subscribers of encoded frames mapped to stream names
+    std::unordered_map<std::string, std::vector<EncodedFrameCallback>, StringHash, std::equal_to<>> encoded_subscribers;
+    std::atomic<bool> has_encoded_subscribers = false; ///< If `encoded_subscribers` isn't empty (checked without lock)
+    std::mutex subscribers_mutex; ///< Mutex for `subscribers`, which can be changed while `run` is delivering frames
 };
 
 }; // namespace farshow
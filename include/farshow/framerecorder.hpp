@@ -0,0 +1,317 @@
+#pragma once
+#include "farshow/framereceiver.hpp"
+#include "farshow/streamexception.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// Alignment of writes to the segment files (required by O_DIRECT)
+#define RECORDING_ALIGNMENT 4096
+/// Number of write buffers - one is filled while the others wait for the writer thread or are being written
+#define RECORDING_BUFFERS 3
+/// Marks the beginning of every record in a segment file ("FSRF")
+#define RECORD_MAGIC 0x46525346
+
+namespace farshow
+{
+
+/**
+ * Header of a frame record in a segment file. It's followed by the stream name (without the terminating null
+ * character) and the encoded image, padded to 8 bytes.
+ */
+struct RecordHeader
+{
+    uint32_t magic;       ///< RECORD_MAGIC
+    uint32_t name_length; ///< length of the stream name
+    uint64_t size;        ///< size of the encoded image
+    uint32_t frame_id;    ///< frame id given by the sender
+    uint32_t stream_id;   ///< number of the stream in the recording
+    uint64_t captured;    ///< capture time (nanoseconds since epoch, sender's clock)
+    uint64_t encoded;     ///< encode time (nanoseconds since epoch, sender's clock)
+    uint64_t first_part;  ///< arrival time of the first part (nanoseconds since epoch)
+    uint64_t last_part;   ///< arrival time of the last part (nanoseconds since epoch)
+    uint64_t reassembled; ///< reassembly time (nanoseconds since epoch)
+};
+
+/**
+ * Entry of a segment index – one per record, in the order of recording
+ */
+struct RecordIndexEntry
+{
+    uint64_t time;      ///< reassembly time of the frame (nanoseconds since epoch)
+    uint64_t offset;    ///< offset of the record in the segment file
+    uint32_t frame_id;  ///< frame id given by the sender
+    uint32_t stream_id; ///< number of the stream in the recording
+};
+
+/**
+ * Records encoded frames to a directory of segment files, without decoding them.
+ *
+ * Each segment is a pair of files: `NNNNNN.frames` with the records (RecordHeader, stream name and image) and
+ * `NNNNNN.index` with a RecordIndexEntry per record. The `streams` file lists the null-terminated stream names in the
+ * order of their numbers. Records are gathered in a large aligned buffer, which is handed to
+ * a writer thread when it's full, so `record` doesn't wait for the disk. The writer writes the buffers with sequential
+ * writes of whole blocks, optionally with O_DIRECT, bypassing the page cache. Index entries are written only after
+ * their records, so the index never points past the written data.
+ */
+class FrameRecorder
+{
+public:
+    /**
+     * Creates the directory (if needed) and the first segment
+     *
+     * @param directory Directory for the segment files, has to be empty or missing
+     * @param segment_size Size after which the next segment is started
+     * @param direct_io If the segment files should be written with O_DIRECT (falls back to buffered writes when the
+     * file system doesn't support it)
+     * @param buffer_size Size of each of the RECORDING_BUFFERS write buffers, rounded up to RECORDING_ALIGNMENT
+     */
+    FrameRecorder(std::string directory, size_t segment_size = size_t(1) << 30, bool direct_io = false,
+                  size_t buffer_size = 8 << 20);
+
+    /**
+     * Closes the recording and stops the writer thread
+     */
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+    /**
+     * Appends the frame to the recording. Can be called from many threads (e.g. as a callback subscribed with
+     * `FrameReceiver::subscribeEncoded` of several receivers). Waits only when all buffers are waiting for the writer.
+     *
+     * Throws the errors of the writer thread.
+     *
+     * @param frame Frame to record
+     */
+    void record(const EncodedFrame &frame);
+
+    /**
+     * Writes the buffered records and their index entries, and waits until they are written
+     */
+    void flush();
+
+    /**
+     * Writes the buffered records and closes the files. Frames recorded later are ignored.
+     */
+    void close();
+
+    /**
+     * Tells if the segment files are written with O_DIRECT
+     *
+     * @returns True if O_DIRECT is used
+     */
+    bool isDirect() { return direct_io; }
+
+    /**
+     * Returns the number of recorded frames
+     *
+     * @returns Number of recorded frames
+     */
+    unsigned long getRecordedFrames();
+
+private:
+    /**
+     * Buffer handed to the writer thread
+     */
+    struct WriteJob
+    {
+        char *buffer;                          ///< aligned data, nullptr when the job finishes the segment
+        size_t size;                           ///< size of the data (aligned)
+        uint64_t offset;                       ///< offset of the data in the segment file, or its final size when the
+                                               ///< job finishes the segment
+        int data_fd;                           ///< segment file
+        int index_fd;                          ///< index file
+        std::vector<RecordIndexEntry> entries; ///< index entries of the records written completely with the data
+    };
+
+    /**
+     * Opens the files of the next segment
+     */
+    void startSegment();
+
+    /**
+     * Hands the buffered data to the writer, which truncates the padding and closes the files of the current segment
+     */
+    void finishSegment();
+
+    /**
+     * Copies the data to the write buffer, handing the buffer to the writer whenever it's full
+     *
+     * @param data Data to append
+     * @param size Size of the data
+     */
+    void append(const void *data, size_t size);
+
+    /**
+     * Hands the buffer to the writer thread, with the index entries of the records written completely, and takes a
+     * free one (waiting for it, if there is none). A partial block at the end is written padded and copied to the next
+     * buffer, to be written again when it's filled.
+     */
+    void submitBuffer();
+
+    /**
+     * Writes the buffers handed by `submitBuffer`, in order, until the recorder is closed
+     */
+    void writeLoop();
+
+    /**
+     * Writes the buffer to the segment file, then the index entries
+     *
+     * @param job Buffer to write
+     */
+    void writeJob(const WriteJob &job);
+
+    /**
+     * Waits until the writer has written everything handed to it
+     */
+    void waitForWriter();
+
+    /**
+     * Throws the error of the writer thread, if there was one since the last call
+     */
+    void throwWriteError();
+
+    std::string directory;       ///< directory with the segment files
+    size_t segment_size;         ///< size after which the next segment is started
+    bool direct_io;              ///< if O_DIRECT is used
+    std::vector<char *> buffers; ///< all aligned write buffers
+    char *buffer = nullptr;      ///< buffer being filled
+    size_t buffer_size;          ///< size of each buffer
+    size_t used = 0;             ///< number of bytes in `buffer`
+    uint64_t buffer_offset = 0;  ///< offset of `buffer` in the segment file (aligned)
+    int data_fd = -1;            ///< current segment file
+    int index_fd = -1;           ///< current index file
+    unsigned segment = 0;        ///< number of the current segment
+    bool closed = false;         ///< if the recording was closed
+    unsigned long frames = 0;    ///< number of recorded frames
+    /// Index entries waiting for their records to be written, with the offsets of the records' ends
+    std::vector<std::pair<RecordIndexEntry, uint64_t>> pending_entries;
+    /// Numbers of the streams
+    std::unordered_map<std::string, uint32_t, StringHash, std::equal_to<>> stream_ids;
+    int streams_fd = -1;       ///< file with the stream names
+    uint64_t streams_size = 0; ///< size of the file with the stream names
+    std::mutex mutex;          ///< mutex for the fields above
+
+    std::deque<WriteJob> jobs;            ///< buffers waiting for the writer
+    std::vector<char *> free_buffers;     ///< buffers which can be filled
+    bool writing = false;                 ///< if the writer is writing a buffer taken from `jobs`
+    bool stopping = false;                ///< if the writer should end when `jobs` is empty
+    std::optional<StreamException> error; ///< first error of the writer, not thrown yet
+    std::mutex writer_mutex;              ///< mutex for the fields above, taken after `mutex`
+    std::condition_variable queued;       ///< notified when a job is queued or the writer should stop
+    std::condition_variable written;      ///< notified when the writer has finished a job
+    std::thread writer;                   ///< thread writing the buffers
+};
+
+/**
+ * Recording made by FrameRecorder, memory-mapped for random access
+ *
+ * Frames are numbered in the order of recording, over all segments. Records are read straight from the mapped
+ * files, so opening even a long recording reads only its index.
+ */
+class FrameRecording
+{
+public:
+    /**
+     * Maps the segment files and their indices
+     *
+     * @param directory Directory with the segment files
+     */
+    FrameRecording(std::string directory);
+
+    /**
+     * Unmaps the files
+     */
+    ~FrameRecording();
+
+    FrameRecording(const FrameRecording &) = delete;
+    FrameRecording &operator=(const FrameRecording &) = delete;
+
+    /**
+     * Returns the number of recorded frames
+     *
+     * @returns Number of frames
+     */
+    size_t size() { return total_frames; }
+
+    /**
+     * Returns the frame. Throws StreamException if its record is damaged.
+     *
+     * @param index Number of the frame in the recording
+     *
+     * @returns Frame pointing to the mapped file, valid as long as the recording
+     */
+    EncodedFrame getFrame(size_t index);
+
+    /**
+     * Finds the first frame (in the order of recording) reassembled at the time or later. Segments with only older
+     * frames are skipped, the index of the others is searched linearly.
+     *
+     * @param time Time to look for
+     *
+     * @returns Number of the frame, `size()` if all frames are older
+     */
+    size_t seekTime(std::chrono::system_clock::time_point time);
+
+    /**
+     * Finds the first frame (in the order of recording) of the stream with the id, with a linear search of the index
+     *
+     * @param name Stream name
+     * @param frame_id Frame id given by the sender
+     *
+     * @returns Number of the frame, nothing if there is no such stream or no such frame
+     */
+    std::optional<size_t> seekFrame(std::string_view name, unsigned frame_id);
+
+    /**
+     * Returns the names of the recorded streams
+     *
+     * @returns Stream names
+     */
+    std::vector<std::string> getStreams();
+
+private:
+    /**
+     * Mapped files of a segment
+     */
+    struct Segment
+    {
+        const char *data;              ///< mapped segment file
+        size_t data_size;              ///< size of the segment file
+        const RecordIndexEntry *index; ///< mapped index file
+        size_t index_size;             ///< size of the index file
+        size_t frames;                 ///< number of valid entries in the index
+        size_t first;                  ///< number of the first frame of the segment in the recording
+        uint64_t last_time;            ///< latest reassembly time in the segment (nanoseconds since epoch)
+    };
+
+    /**
+     * Finds the segment and the index entry of the frame
+     *
+     * @param index Number of the frame in the recording
+     *
+     * @returns Segment and the index entry
+     */
+    std::pair<const Segment *, const RecordIndexEntry *> locate(size_t index);
+
+    /**
+     * Unmaps the files of all segments
+     */
+    void unmap();
+
+    std::vector<Segment> segments;         ///< mapped segments, in order
+    size_t total_frames = 0;               ///< number of frames in all segments
+    std::vector<std::string> stream_names; ///< stream names, indexed by stream id
+};
+
+}; // namespace farshow
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "farshow/stats.hpp"
 #include "farshow/udpinterface.hpp"
 #include <opencv2/imgcodecs.hpp>
 
@@ -20,7 +21,7 @@ public:
      * @param frame_parts_delay Amount of sleep time in microseconds between sending frame parts
      */
     FrameSender(std::string client_address, int client_port = 1100, unsigned frame_parts_delay = 500)
-        : UdpInterface(client_address, client_port)
+        : UdpInterface(client_address, client_port), frame_parts_delay(frame_parts_delay)
     {
         // Enable broadcasting
         int broadcast = 1;
@@ -35,13 +36,53 @@ public:
      * @param name Title of the stream
      * @param extension Extension determining output format (`.jpg`, `.png` ...)
      * @param encoding_params Format-specific parameters for cv::imencode
+     * @param capture_time When the frame was captured (if not provided, the time of the call is used)
      */
     void sendFrame(cv::Mat &frame, std::string name, std::string extension = ".jpg",
-                   std::vector<int> encoding_params = {cv::IMWRITE_JPEG_QUALITY, 95});
+                   std::vector<int> encoding_params = {cv::IMWRITE_JPEG_QUALITY, 95},
+                   std::chrono::system_clock::time_point capture_time = {});
+
+    /**
+     * Sends an already encoded frame (in parts if it's too big to fit the datagram).
+     *
+     * With `frame_parts_delay` set to 0 and the io_uring transport, all parts are submitted in batches and the call
+     * returns when they are sent.
+     *
+     * @param data Encoded frame (e.g. the output of cv::imencode)
+     * @param size Size of the encoded frame
+     * @param name Title of the stream
+     * @param capture_time When the frame was captured (if not provided, the time of the call is used)
+     * @param encode_time When the frame was encoded (if not provided, the time of the call is used)
+     */
+    void sendEncodedFrame(const uchar *data, size_t size, std::string name,
+                          std::chrono::system_clock::time_point capture_time = {},
+                          std::chrono::system_clock::time_point encode_time = {});
+
+    /**
+     * Returns counters of every sent stream. Can be called from any thread – the sending thread updates the counters
+     * without locking.
+     *
+     * @returns Counters mapped to stream names
+     */
+    std::unordered_map<std::string, SenderStreamSnapshot> getStreamStats() { return stream_stats.snapshot(); }
 
     unsigned frame_parts_delay = 500; ///< Amount of sleep time in microseconds between sending frame parts
 private:
-    unsigned curr_frame_id = 0; ///< Id for the next frame
+    /**
+     * Finds the counters of the stream without locking, unless the stream is new
+     *
+     * @param name Stream name
+     *
+     * @returns Counters of the stream
+     */
+    SenderStreamStats &getStats(const std::string &name);
+
+    StatsRegistry<SenderStreamStats> stream_stats; ///< Counters of all streams
+    /// Ids for the next frames of the streams – frames of each stream are numbered on their own, so the receiver can
+    /// find the missing ones
+    std::unordered_map<std::string, unsigned> next_frame_ids;
+    /// Counters already taken from `stream_stats`, used by the sending thread without locking
+    std::unordered_map<std::string, std::shared_ptr<SenderStreamStats>> local_stats;
 };
 
 }; // namespace farshow
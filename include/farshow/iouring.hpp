@@ -0,0 +1,178 @@
+#pragma once
+
+#include <chrono>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+
+namespace farshow
+{
+
+/**
+ * Minimal io_uring instance, set up with raw system calls (no liburing dependency)
+ */
+class IoUring
+{
+public:
+    /**
+     * Creates the ring and maps its queues
+     *
+     * @param entries Size of the submission queue
+     */
+    IoUring(unsigned entries);
+
+    /**
+     * Unmaps the queues and closes the ring
+     */
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    /**
+     * Returns a cleared submission queue entry to fill
+     *
+     * @returns Submission queue entry, nullptr if the queue is full
+     */
+    io_uring_sqe *getSqe();
+
+    /**
+     * Submits prepared entries and waits for completions
+     *
+     * @param wait_nr Number of completions to wait for
+     * @param timeout Longest time to wait for the completions, nullptr to wait without a limit
+     *
+     * @returns Number of submitted entries, or negative error code (-ETIME if nothing was submitted and the timeout
+     * has passed)
+     */
+    int submit(unsigned wait_nr = 0, const __kernel_timespec *timeout = nullptr);
+
+    /**
+     * Returns the oldest completion without removing it from the queue
+     *
+     * @returns Completion queue entry, nullptr if there are no completions
+     */
+    io_uring_cqe *peekCqe();
+
+    /**
+     * Removes the oldest completion from the queue
+     */
+    void seenCqe();
+
+private:
+    int fd = -1;                  ///< ring file descriptor
+    void *sq_ring = nullptr;      ///< mapped submission queue ring
+    size_t sq_ring_size = 0;      ///< size of `sq_ring`
+    void *cq_ring = nullptr;      ///< mapped completion queue ring (same as `sq_ring` with single mmap)
+    size_t cq_ring_size = 0;      ///< size of `cq_ring`
+    io_uring_sqe *sqes = nullptr; ///< mapped submission queue entries
+    size_t sqes_size = 0;         ///< size of `sqes`
+    unsigned *sq_head, *sq_tail;  ///< submission queue head (moved by the kernel) and tail
+    unsigned *sq_mask, *sq_array; ///< submission queue index mask and indirection array
+    unsigned *cq_head, *cq_tail;  ///< completion queue head and tail (moved by the kernel)
+    unsigned *cq_mask;            ///< completion queue index mask
+    io_uring_cqe *cqes;           ///< completion queue entries
+    unsigned sq_entries;          ///< size of the submission queue
+    unsigned local_tail = 0;      ///< submission queue tail, including entries not submitted yet
+    unsigned pending = 0;         ///< prepared, but not submitted entries
+};
+
+/**
+ * io_uring transport for UdpInterface
+ *
+ * Receives with a multishot recvmsg into buffers provided to the kernel, so one submission keeps receiving datagrams
+ * without further system calls while they keep coming. Used buffers are given back with submissions queued along
+ * with the next wait. Sends datagrams as batches of sendmsg submissions, submitted
+ * with a single system call.
+ */
+class IoUringTransport
+{
+public:
+    /**
+     * Sets up the ring
+     *
+     * @param socket Socket to use
+     * @param address Destination address of sent datagrams
+     */
+    IoUringTransport(int socket, const sockaddr_in &address);
+
+    /**
+     * Frees the buffers
+     */
+    ~IoUringTransport();
+
+    /**
+     * Waits for a datagram
+     *
+     * @param data Set to the received datagram, valid until the next call
+     * @param control Set to point at the ancillary data of the datagram, valid until the next call
+     * @param deadline Time after which waiting is given up
+     *
+     * @returns Size of the datagram, 0 if the socket was shut down, negative error code on failure (-EINVAL when
+     * the kernel doesn't support multishot recvmsg, -ETIME when the deadline has passed)
+     */
+    long receive(const char *&data, msghdr &control,
+                 std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+    /**
+     * Queues a datagram to send. Sends the queued datagrams if the batch is full.
+     *
+     * @param data Datagram
+     * @param size Size of the datagram
+     *
+     * @returns 0 on success, negative error code otherwise
+     */
+    int send(const void *data, size_t size);
+
+    /**
+     * Sends all queued datagrams and waits until they are sent
+     *
+     * @returns 0 on success, negative error code of the first failed send otherwise
+     */
+    int flush();
+
+private:
+    /**
+     * Allocates the buffers for received datagrams and provides them to the kernel
+     *
+     * @returns 0 on success, negative error code otherwise
+     */
+    int setupReceive();
+
+    /**
+     * Starts the multishot recvmsg (and waiting for the shutdown of the socket)
+     */
+    void armReceive();
+
+    /**
+     * Gives the buffer back to the kernel
+     *
+     * @param id Buffer id
+     */
+    void recycleBuffer(unsigned id);
+
+    /**
+     * Slot for a datagram waiting to be sent
+     */
+    struct SendSlot
+    {
+        std::vector<char> data; ///< copy of the datagram
+        iovec iov;              ///< points to `data`
+        msghdr msg;             ///< message with the destination address
+    };
+
+    IoUring ring;                ///< the ring
+    int socket;                  ///< socket to use
+    sockaddr_in address;         ///< destination address
+    char *buffers = nullptr;     ///< memory of the provided buffers
+    msghdr receive_msg = {};     ///< recvmsg template, determines the layout of received buffers
+    bool armed = false;          ///< if the multishot recvmsg is active
+    bool watching = false;       ///< if the shutdown of the socket is awaited
+    bool shut_down = false;      ///< if the socket was shut down
+    int used_buffer = -1;        ///< buffer returned by the last `receive`, recycled on the next call
+    std::vector<SendSlot> slots; ///< slots for datagrams to send
+    unsigned queued = 0;         ///< number of used slots
+};
+
+}; // namespace farshow
@@ -0,0 +1,34 @@
+#pragma once
+#include "farshow/framereceiver.hpp"
+
+namespace farshow
+{
+
+/**
+ * Decodes a JPEG frame to I420 planes, skipping the color conversion and chroma upsampling done by cv::imdecode
+ *
+ * Only baseline YCbCr images with 4:2:0 chroma subsampling and even dimensions (as written by cv::imencode) are
+ * decoded, for other frames the function returns false. Can be passed to `FrameReceiver::setDecoder`.
+ *
+ * @param encoded Complete, encoded frame
+ * @param frame Frame whose `img` and `format` are set
+ *
+ * @returns True if the frame was decoded
+ */
+bool decodeJpegYuv(const EncodedFrame &encoded, Frame &frame);
+
+/**
+ * Decodes a JPEG frame to BGR at the smallest of the 1/8, 1/4, 1/2 and 1/1 scales that still covers the given size
+ *
+ * The scaling is done by libjpeg's DCT, so the smaller the scale, the less work the decoding takes. CMYK images aren't
+ * decoded, for them (and other formats) the function returns false.
+ *
+ * @param encoded Complete, encoded frame
+ * @param frame Frame whose `img` and `format` are set
+ * @param size Smallest size of the decoded image (unless the frame is smaller)
+ *
+ * @returns True if the frame was decoded
+ */
+bool decodeJpegScaled(const EncodedFrame &encoded, Frame &frame, cv::Size size);
+
+}; // namespace farshow
@@ -0,0 +1,177 @@
+#pragma once
+#include "farshow/framemailbox.hpp"
+#include "farshow/framereceiver.hpp"
+
+#include <exception>
+#include <thread>
+
+namespace farshow
+{
+
+/**
+ * Receiver spreading streams from one port over several threads.
+ *
+ * Each shard is a FrameReceiver with its own socket bound with SO_REUSEPORT to the same port, running in its own
+ * thread. A classic BPF program attached to the socket group steers the datagrams by the stream name, so all parts of a
+ * stream reach the same shard. Completed frames from all shards are merged into one queue, read with `receiveFrame`, and
+ * delivered to the subscribers.
+ */
+class ShardedFrameReceiver
+{
+public:
+    /**
+     * Creates and binds the sockets, attaches the steering program and starts the shard threads
+     *
+     * @param client_address Client's ip address (if not provided, binds the sockets to all available interfaces)
+     * @param client_port Client's port
+     * @param shards Number of shards (0 means one shard per hardware thread)
+     * @param limits Limits of memory used for reassembling frames (applied to each shard)
+     * @param queue_capacity Maximum number of frames waiting in the merged queue for `receiveFrame`
+     * @param transport Transport used by the shards
+     */
+    ShardedFrameReceiver(std::string client_address = "", int client_port = 1100, unsigned shards = 0,
+                         ReassemblyLimits limits = ReassemblyLimits(), size_t queue_capacity = 64,
+                         Transport transport = Transport::SOCKET);
+
+    /**
+     * Stops the shards and waits for their threads
+     */
+    ~ShardedFrameReceiver();
+
+    /**
+     * Waits for a frame completed by any of the shards
+     *
+     * @returns Received frame, or an empty frame if the receiver was stopped
+     */
+    Frame receiveFrame();
+
+    /**
+     * Registers a callback for frames from the stream. All frames of a stream are completed by the same shard, so the
+     * callback is never called concurrently for the same stream, but it can be called concurrently for different
+     * streams. It must not call `subscribe` or `unsubscribe`.
+     *
+     * @param name Stream name (empty name subscribes to all streams)
+     * @param callback Function called with every frame from the stream
+     */
+    void subscribe(std::string name, FrameCallback callback);
+
+    /**
+     * Registers a callback for encoded frames from the stream, called before they're decoded. As with `subscribe`, the
+     * callback can be called concurrently for different streams.
+     *
+     * @param name Stream name (empty name subscribes to all streams)
+     * @param callback Function called with every encoded frame from the stream
+     */
+    void subscribeEncoded(std::string name, EncodedFrameCallback callback);
+
+    /**
+     * Creates a mailbox for frames from the stream, collecting the frames from all shards
+     *
+     * @param name Stream name (empty name subscribes to all streams)
+     * @param mode Delivery mode – keep only the latest frame or keep frames in a bounded queue
+     * @param capacity Maximum number of queued frames in DeliveryMode::QUEUE
+     *
+     * @returns Mailbox from which the consumer takes frames. It's closed when the receiver stops.
+     */
+    std::shared_ptr<FrameMailbox> subscribe(std::string name, DeliveryMode mode = DeliveryMode::LATEST,
+                                            size_t capacity = 1);
+
+    /**
+     * Removes all callbacks and mailboxes subscribed to the stream
+     *
+     * @param name Stream name
+     */
+    void unsubscribe(std::string name);
+
+    /**
+     * Sets which streams should be received by all shards
+     *
+     * @param mode Whether to receive only the listed streams, or all streams except them
+     * @param names Stream names
+     */
+    void setStreamFilter(FilterMode mode, std::vector<std::string> names);
+
+    /**
+     * Removes the stream filter from all shards
+     */
+    void clearStreamFilter();
+
+    /**
+     * Sets if frames of the stream are decoded by all shards
+     *
+     * @param name Stream name
+     * @param visible If the stream should be decoded
+     *
+     * @returns The newest frame kept while the stream was hidden, when it becomes visible again
+     */
+    std::optional<Frame> setStreamVisible(const std::string &name, bool visible);
+
+    /**
+     * Limits how many frames of the stream are decoded per second by all shards
+     *
+     * @param name Stream name (empty name sets the limit of streams without their own one)
+     * @param rate Maximum number of decoded frames per second, 0 for no limit
+     */
+    void setMaxDecodeRate(const std::string &name, float rate);
+
+    /**
+     * Sets the function decoding the frames in all shards. As with `subscribe`, it can be called concurrently for
+     * different streams. Should be called before `run`.
+     *
+     * @param decoder Decoding function, empty to decode all frames with cv::imdecode
+     */
+    void setDecoder(FrameDecoder decoder);
+
+    /**
+     * Returns reassembly counters summed over all shards
+     *
+     * @returns Reassembly counters
+     */
+    ReassemblyStats getReassemblyStats();
+
+    /**
+     * Returns counters of every stream, summed over all shards
+     *
+     * @returns Counters mapped to stream names
+     */
+    std::unordered_map<std::string, ReceiverStreamSnapshot> getStreamStats();
+
+    /**
+     * Tells if the packets are steered by the stream name. If attaching the BPF program failed (e.g. on kernels older
+     * than 4.5), the kernel spreads the packets by the sender address and port, so all streams from one sender end up
+     * in the same shard.
+     *
+     * @returns True if the steering program is attached
+     */
+    bool isSteered() { return steered; }
+
+    /**
+     * Returns the number of shards
+     *
+     * @returns Number of shards
+     */
+    unsigned getShardCount() { return shards.size(); }
+
+    /**
+     * Shuts the sockets down, which stops the shards. Frames already in the merged queue can still be received.
+     */
+    void stop();
+
+private:
+    /**
+     * Attaches the program steering datagrams by the stream name to the socket group
+     *
+     * @returns True if the program was attached
+     */
+    bool attachSteeringProgram();
+
+    std::vector<std::unique_ptr<FrameReceiver>> shards; ///< Receivers sharing the port
+    std::vector<std::thread> threads;                   ///< Threads running the shards
+    std::shared_ptr<FrameMailbox> merged;               ///< Frames completed by all shards, for `receiveFrame`
+    std::exception_ptr error;                           ///< Exception thrown by any of the shards
+    std::mutex error_mutex;                             ///< Mutex for `error`
+    bool steered = false;                               ///< If the steering program is attached
+    bool stopped = false;                               ///< If the sockets were shut down
+};
+
+}; // namespace farshow
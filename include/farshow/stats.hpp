@@ -0,0 +1,240 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Number of histogram buckets – bucket 0 counts durations below 1 µs, bucket i counts [2^(i-1), 2^i) µs, the last
+/// one counts everything longer
+#define HISTOGRAM_BUCKETS 32
+
+namespace farshow
+{
+
+/**
+ * Copy of a histogram taken at one moment
+ */
+struct HistogramSnapshot
+{
+    std::vector<uint64_t> buckets; ///< counts of durations in the buckets (see HISTOGRAM_BUCKETS)
+    uint64_t count = 0;            ///< number of recorded durations
+    uint64_t total_us = 0;         ///< sum of recorded durations in microseconds
+    uint64_t max_us = 0;           ///< longest recorded duration in microseconds
+
+    /**
+     * Returns the mean duration
+     *
+     * @returns Mean duration in microseconds, 0 if nothing was recorded
+     */
+    double mean() const { return count ? (double)total_us / count : 0; }
+
+    /**
+     * Returns an upper bound of the percentile, with the precision of the bucket
+     *
+     * @param percent Percentile (e.g. 99)
+     *
+     * @returns Upper bound of the bucket containing the percentile in microseconds (never more than `max_us`), 0 if
+     * nothing was recorded
+     */
+    uint64_t percentile(double percent) const;
+
+    /**
+     * Adds the counts of another histogram
+     *
+     * @param other Histogram to add
+     */
+    void merge(const HistogramSnapshot &other);
+};
+
+/**
+ * Histogram of durations with logarithmic buckets. Recording never locks, so it can be done in the hot path while
+ * other threads take snapshots.
+ */
+class Histogram
+{
+public:
+    /**
+     * Records the duration
+     *
+     * @param duration Duration (negative durations are counted as 0)
+     */
+    void record(std::chrono::nanoseconds duration);
+
+    /**
+     * Copies the counts
+     *
+     * @returns Current counts
+     */
+    HistogramSnapshot snapshot() const;
+
+private:
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> buckets{}; ///< counts of durations in the buckets
+    std::atomic<uint64_t> count = 0;                                 ///< number of recorded durations
+    std::atomic<uint64_t> total_us = 0;                              ///< sum of recorded durations in microseconds
+    std::atomic<uint64_t> max_us = 0;                                ///< longest recorded duration in microseconds
+};
+
+/**
+ * Counters of a sent stream, taken at one moment
+ */
+struct SenderStreamSnapshot
+{
+    uint64_t frames = 0;           ///< number of sent frames
+    uint64_t bytes = 0;            ///< size of sent encoded frames
+    uint64_t parts = 0;            ///< number of sent datagrams
+    uint64_t drops = 0;            ///< number of frames, which failed to send
+    HistogramSnapshot encode_time; ///< time of encoding a frame (only frames sent with `sendFrame`)
+    HistogramSnapshot send_time;   ///< time of sending all parts of a frame (including `frame_parts_delay`)
+
+    /**
+     * Adds the counters of another snapshot of the same stream
+     *
+     * @param other Snapshot to add
+     */
+    void merge(const SenderStreamSnapshot &other);
+};
+
+/**
+ * Live counters of a sent stream, updated by the sending thread
+ */
+struct SenderStreamStats
+{
+    typedef SenderStreamSnapshot Snapshot;
+
+    std::atomic<uint64_t> frames = 0; ///< number of sent frames
+    std::atomic<uint64_t> bytes = 0;  ///< size of sent encoded frames
+    std::atomic<uint64_t> parts = 0;  ///< number of sent datagrams
+    std::atomic<uint64_t> drops = 0;  ///< number of frames, which failed to send
+    Histogram encode_time;            ///< time of encoding a frame
+    Histogram send_time;              ///< time of sending all parts of a frame
+
+    /**
+     * Copies the counters
+     *
+     * @returns Current counters
+     */
+    Snapshot snapshot() const;
+};
+
+/**
+ * Counters of a received stream, taken at one moment
+ */
+struct ReceiverStreamSnapshot
+{
+    uint64_t packets = 0;              ///< number of received parts (including duplicates)
+    uint64_t bytes = 0;                ///< size of received parts
+    uint64_t duplicate_parts = 0;      ///< number of parts received more than once (or late parts of delivered frames)
+    uint64_t dropped_frames = 0;       ///< number of frames dropped before receiving all their parts
+    uint64_t lost_parts = 0;           ///< number of parts missing in the dropped frames
+    uint64_t missing_frames = 0;       ///< number of frames of which no part arrived (gaps in the frame ids)
+    uint64_t evicted_frames = 0;       ///< number of incomplete frames evicted by the reassembly limits
+    uint64_t frames = 0;               ///< number of decoded and delivered frames
+    uint64_t complete_frames = 0;      ///< number of completely reassembled frames, including the ones not decoded
+                                       ///< (of hidden or rate-limited streams, or with only encoded subscribers)
+    uint64_t skipped_frames = 0;       ///< number of complete frames replaced by newer ones before they were decoded
+                                       ///< (because of the decode rate limit)
+    HistogramSnapshot reassembly_time; ///< time from the arrival of the first part of a frame to its completion
+    HistogramSnapshot decode_time;     ///< time of decoding a frame
+    double fps = 0;                    ///< recent rate of decoded frames (decays when the stream stops)
+
+    /**
+     * Adds the counters of another snapshot of the same stream
+     *
+     * @param other Snapshot to add
+     */
+    void merge(const ReceiverStreamSnapshot &other);
+};
+
+/**
+ * Live counters of a received stream, updated by the receiving thread
+ */
+struct ReceiverStreamStats
+{
+    typedef ReceiverStreamSnapshot Snapshot;
+
+    std::atomic<uint64_t> packets = 0;         ///< number of received parts
+    std::atomic<uint64_t> bytes = 0;           ///< size of received parts
+    std::atomic<uint64_t> duplicate_parts = 0; ///< number of duplicated parts
+    std::atomic<uint64_t> dropped_frames = 0;  ///< number of frames dropped before they were complete
+    std::atomic<uint64_t> lost_parts = 0;      ///< number of parts missing in dropped frames
+    std::atomic<uint64_t> missing_frames = 0;  ///< number of frames of which no part arrived
+    std::atomic<uint64_t> evicted_frames = 0;  ///< number of evicted frames
+    std::atomic<uint64_t> frames = 0;          ///< number of decoded and delivered frames
+    std::atomic<uint64_t> complete_frames = 0; ///< number of completely reassembled frames
+    std::atomic<uint64_t> skipped_frames = 0;  ///< number of frames not decoded because of the decode rate limit
+    Histogram reassembly_time;                 ///< time from the first part of a frame to its completion
+    Histogram decode_time;                     ///< time of decoding a frame
+    std::atomic<int64_t> last_frame = 0;       ///< when the last frame was decoded (steady clock, nanoseconds)
+    std::atomic<int64_t> frame_interval = 0;   ///< smoothed interval between decoded frames in nanoseconds
+
+    /**
+     * Counts a decoded and delivered frame and updates the frame rate. Called only by the receiving thread.
+     *
+     * @param now Time of the delivery
+     */
+    void frameDelivered(std::chrono::steady_clock::time_point now);
+
+    /**
+     * Copies the counters
+     *
+     * @returns Current counters
+     */
+    Snapshot snapshot() const;
+};
+
+/**
+ * Counters of all streams, mapped to their names.
+ *
+ * The lock is taken only to find a stream's counters (which the hot path does once and keeps the pointer) and to take
+ * snapshots – updating the counters never locks. Counters of streams forgotten by the receiver are kept.
+ */
+template <typename Stats> class StatsRegistry
+{
+public:
+    /**
+     * Finds the counters of the stream, creates them if the stream is new
+     *
+     * @param name Stream name
+     *
+     * @returns Counters of the stream, valid as long as the registry
+     */
+    std::shared_ptr<Stats> get(std::string_view name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<Stats> &stats = streams[std::string(name)];
+        if (!stats)
+        {
+            stats = std::make_shared<Stats>();
+        }
+        return stats;
+    }
+
+    /**
+     * Copies the counters of all streams
+     *
+     * @returns Counters mapped to stream names
+     */
+    std::unordered_map<std::string, typename Stats::Snapshot> snapshot()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<std::string, typename Stats::Snapshot> result;
+        for (auto &stream : streams)
+        {
+            result.emplace(stream.first, stream.second->snapshot());
+        }
+        return result;
+    }
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<Stats>> streams; ///< counters mapped to stream names
+    std::mutex mutex;                                                ///< mutex for `streams`
+};
+
+}; // namespace farshow
@@ -0,0 +1,105 @@
+#pragma once
+#include "farshow/client.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace farshow
+{
+
+/**
+ * Shows all streams as tiles of an automatic grid, filling the whole window
+ *
+ * The frames of all tiles are downscaled to the grid cell and uploaded to a single texture atlas, so the wall is drawn
+ * with one draw call, however many streams there are. Clicking a tile focuses its stream – only that stream is
+ * decoded in full resolution and shown in its own `FrameWindow`, until the window is closed.
+ *
+ * `decode` is called from the receiving thread, all the other methods from the main thread.
+ */
+class StreamWall
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param focused_decoder Decoder of the focused stream (e.g. `decodeJpegYuv`), empty to decode it with cv::imdecode
+     */
+    StreamWall(FrameDecoder focused_decoder = FrameDecoder()) : focused_decoder(focused_decoder) {}
+
+    /**
+     * Decodes a frame for the wall – downscaled to the grid cell, or in full resolution if its stream is focused
+     *
+     * JPEG frames are decoded at a reduced scale by libjpeg, others are decoded in full resolution and then resized.
+     * Can be passed to `FrameReceiver::setDecoder`.
+     *
+     * @param encoded Complete, encoded frame
+     * @param frame Decoded frame
+     *
+     * @returns True (the frame is always decoded)
+     */
+    bool decode(const EncodedFrame &encoded, Frame &frame);
+
+    /**
+     * Replaces the image of the frame's tile, or of the focused window. Adds a tile for a new stream.
+     *
+     * @param frame Received frame
+     */
+    void changeFrame(Frame &frame);
+
+    /**
+     * Uploads the changed tiles and prepares the Dear ImGui window with the wall (and the focused stream's window)
+     */
+    void display();
+
+    ~StreamWall();
+
+private:
+    /**
+     * Stream shown on the wall
+     */
+    struct Tile
+    {
+        std::string name;    ///< name of the stream
+        cv::Mat img;         ///< newest image, fitting the grid cell
+        bool changed = true; ///< if the img has changed since it was uploaded to the atlas
+    };
+
+    FrameDecoder focused_decoder;                     ///< Decoder of the focused stream
+    std::vector<Tile> tiles;                          ///< Tiles in the order of the grid
+    std::unordered_map<std::string, size_t> tile_ids; ///< Indices of the tiles by stream name
+    GLuint atlas = 0;                                 ///< Texture with the images of all tiles
+    int columns = 0;                                  ///< Number of columns of the grid
+    int rows = 0;                                     ///< Number of rows of the grid
+    cv::Size cell;                                    ///< Size of a grid cell in pixels
+    GLuint pbos[PBO_COUNT] = {0};                     ///< Pixel buffers for uploading the tiles
+    unsigned next_pbo = 0;                            ///< Pixel buffer for the next upload
+    std::atomic<int> cell_width = 0;                  ///< `cell` for the receiving thread
+    std::atomic<int> cell_height = 0;                 ///< `cell` for the receiving thread
+    std::string focused;                              ///< Name of the focused stream, empty if there's none
+    std::mutex focused_mutex;                         ///< Guards `focused`, when read by the receiving thread
+    std::unique_ptr<FrameWindow> focused_window;      ///< Window of the focused stream
+
+    /**
+     * Changes the focused stream
+     *
+     * @param name Name of the stream, empty to show only the wall
+     */
+    void focus(const std::string &name);
+
+    /**
+     * Computes the grid for the number of tiles and the size of the window, and allocates the atlas for it
+     *
+     * @param size Size of the area for the wall
+     */
+    void layout(ImVec2 size);
+
+    /**
+     * Copies the changed tiles to the next pixel buffer of the ring and updates their parts of the atlas from it
+     */
+    void upload();
+};
+
+}; // namespace farshow
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace farshow
+{
+
+/**
+ * Lock-free triple buffer passing the newest value from one producer thread to one consumer thread
+ *
+ * The producer fills the back slot and publishes it, the consumer takes the newest published slot as its front one.
+ * The third slot is swapped between them with a single atomic exchange, so neither side ever waits for the other –
+ * values published faster than they are consumed are overwritten.
+ */
+template <typename T> class TripleBuffer
+{
+public:
+    /**
+     * Returns the slot to fill. Can be used only by the producer.
+     *
+     * @returns Back slot
+     */
+    T &back() { return slots[back_index]; }
+
+    /**
+     * Makes the back slot the newest value and takes a free slot as the next back one. Can be used only by the
+     * producer.
+     */
+    void publish()
+    {
+        uint8_t previous = middle.exchange(back_index | FRESH, std::memory_order_acq_rel);
+        back_index = previous & INDEX;
+    }
+
+    /**
+     * Takes the newest published value, if there is one the consumer hasn't seen yet. Can be used only by the consumer.
+     *
+     * @returns True if `front()` changed
+     */
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return false;
+        }
+        uint8_t previous = middle.exchange(front_index, std::memory_order_acq_rel);
+        front_index = previous & INDEX;
+        return true;
+    }
+
+    /**
+     * Returns the value taken by the last successful `update()`. Can be used only by the consumer.
+     *
+     * @returns Front slot
+     */
+    T &front() { return slots[front_index]; }
+
+private:
+    static constexpr uint8_t INDEX = 0x3; ///< bits of the slot index in `middle`
+    static constexpr uint8_t FRESH = 0x4; ///< set in `middle` when it holds a value the consumer hasn't taken
+
+    T slots[3];                      ///< the three slots
+    uint8_t back_index = 0;          ///< slot of the producer
+    std::atomic<uint8_t> middle = 1; ///< slot between the producer and the consumer, with the FRESH flag
+    uint8_t front_index = 2;         ///< slot of the consumer
+};
+
+}; // namespace farshow
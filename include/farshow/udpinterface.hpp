@@ -1,9 +1,17 @@
 #pragma once
 
 #include <arpa/inet.h> // sockaddr_in
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <string>
 
 #define DATAGRAM_SIZE 65507
+#define CONTROL_SIZE 64 ///< size of the buffer for ancillary data (e.g. timestamps) of a received datagram
+
+#define FRAME_MAGIC 0x57485346 ///< "FSHW" in the first bytes of every datagram with a frame
+#define FRAME_VERSION 2        ///< Version of FrameHeader, changed with every change of its layout
 
 namespace farshow
 {
@@ -13,12 +21,41 @@ namespace farshow
  */
 struct FrameHeader
 {
-    unsigned name_length; ///< length of stream name
-    unsigned frame_id;    ///< id of the frame in this stream
-    unsigned part_id;     ///< part id
-    unsigned total_parts; ///< how many parts of the frame were send
+    uint32_t magic = FRAME_MAGIC;     ///< FRAME_MAGIC, so other datagrams (and old senders) are rejected
+    uint32_t version = FRAME_VERSION; ///< FRAME_VERSION of the sender
+    unsigned name_length;             ///< length of stream name
+    unsigned frame_id;                ///< id of the frame in this stream
+    unsigned part_id;                 ///< part id
+    unsigned total_parts;             ///< how many parts of the frame were send
+    uint64_t capture_time;            ///< when the frame was captured (sender's clock, see `toWireTime`)
+    uint64_t encode_time;             ///< when the frame was encoded (sender's clock, see `toWireTime`)
 };
 
+/**
+ * Converts the time to its representation in FrameHeader – nanoseconds since the epoch
+ *
+ * @param time Time to convert
+ *
+ * @returns Nanoseconds since the epoch
+ */
+inline uint64_t toWireTime(std::chrono::system_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+/**
+ * Converts the time from its representation in FrameHeader
+ *
+ * @param time Nanoseconds since the epoch
+ *
+ * @returns Time point
+ */
+inline std::chrono::system_clock::time_point fromWireTime(uint64_t time)
+{
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(time)));
+}
+
 /**
  * Message with the frame (or part of it)
  */
@@ -29,6 +66,17 @@ typedef struct FrameMessage
                                                    ///< (remaining bytes)
 } FrameMessage;
 
+/**
+ * Way of sending and receiving datagrams
+ */
+enum class Transport
+{
+    SOCKET,  ///< Plain recv/sendto system calls
+    IO_URING ///< io_uring – multishot recvmsg into provided buffers, batched sendmsg submissions
+};
+
+class IoUringTransport;
+
 /**
  * Handles UDP Interface
  */
@@ -48,9 +96,77 @@ public:
      */
     ~UdpInterface();
 
+    /**
+     * Selects the transport. Should be called before sending or receiving starts.
+     *
+     * If io_uring can't be set up (e.g. it's not supported by the kernel or disabled), plain sockets are used.
+     *
+     * @param transport Requested transport
+     *
+     * @returns Transport which will be used
+     */
+    Transport setTransport(Transport transport);
+
+    /**
+     * Returns the transport in use
+     *
+     * @returns Transport in use
+     */
+    Transport getTransport() { return transport; }
+
 protected:
-    struct sockaddr_in clientAddr = {0}; ///< client's ip address structure
-    int mySocket;                        ///< socket binded to client address
+    /**
+     * Waits for a datagram and sets `receive_time`
+     *
+     * @param data Set to the received datagram, valid until the next call
+     *
+     * @returns Size of the datagram, 0 if the socket was shut down
+     */
+    size_t receiveDatagram(const char *&data);
+
+    /**
+     * Waits for a datagram until the deadline and sets `receive_time`
+     *
+     * @param data Set to the received datagram, valid until the next call
+     * @param deadline Time after which waiting is given up
+     *
+     * @returns Size of the datagram, 0 if the socket was shut down, nothing if the deadline has passed
+     */
+    std::optional<size_t> receiveDatagram(const char *&data, std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * Sends the datagram to the client. With io_uring it may be only queued, until `flushDatagrams` is called.
+     *
+     * @param data Datagram
+     * @param size Size of the datagram
+     */
+    void sendDatagram(const void *data, size_t size);
+
+    /**
+     * Waits until all queued datagrams are sent
+     */
+    void flushDatagrams();
+
+    struct sockaddr_in clientAddr = {0};                ///< client's ip address structure
+    int mySocket;                                       ///< socket binded to client address
+    std::chrono::system_clock::time_point receive_time; ///< when the last datagram was received (by the kernel if
+                                                        ///< SO_TIMESTAMPNS is enabled on the socket, otherwise when
+                                                        ///< it was read)
+    uint32_t dropped_datagrams = 0; ///< number of datagrams dropped by the kernel, because the receive buffer was full,
+                                    ///< before the last received one (if SO_RXQ_OVFL is enabled on the socket)
+
+private:
+    /**
+     * Reads ancillary data of the received datagram
+     *
+     * @param msg Message with the ancillary data
+     */
+    void readControl(const struct msghdr &msg);
+
+    Transport transport = Transport::SOCKET; ///< transport in use
+    std::unique_ptr<IoUringTransport> uring; ///< io_uring state, when it's the transport in use
+    std::unique_ptr<FrameMessage> datagram;  ///< buffer for datagrams received from the socket
+    char control[CONTROL_SIZE];              ///< buffer for ancillary data received from the socket
 };
 
 }; // namespace farshow
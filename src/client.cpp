@@ -6,14 +6,158 @@
 #include "imgui/backends/imgui_impl_glfw.h"
 #include "imgui/backends/imgui_impl_opengl3.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <opencv2/imgproc.hpp>
 #include <thread>
 
 #define GLSL_VERSION "#version 130"
+#define SMOOTHING 0.1f    ///< weight of a new sample in the moving averages of latency and frame interval
+#define OVERLAY_PADDING 5 ///< space around the text of the performance overlay in pixels
 
 namespace farshow
 {
 
+/**
+ * Format of a texture holding an image, uploaded without converting its pixels
+ */
+struct TextureFormat
+{
+    GLint internal_format; ///< format of the texture
+    GLenum format;         ///< order of the image's channels
+    GLenum type;           ///< type of the image's channels
+    GLint swizzle[4];      ///< sources of the red, green, blue and alpha components (for gray images)
+};
+
+/**
+ * Finds the texture format matching the image
+ *
+ * Gray images (with or without alpha) are kept in one or two channels, which are expanded to gray by the swizzle. When
+ * the swizzle isn't supported, the luminance formats are used instead.
+ *
+ * @param image Image (8-bit, 16-bit or float with 1 to 4 channels)
+ *
+ * @returns Texture format
+ */
+static TextureFormat getTextureFormat(const cv::Mat &image)
+{
+    bool swizzle = GLEW_VERSION_3_3 || GLEW_ARB_texture_swizzle;
+    GLenum data_type = image.depth() == CV_16U   ? GL_UNSIGNED_SHORT
+                       : image.depth() == CV_32F ? GL_FLOAT
+                                                 : GL_UNSIGNED_BYTE;
+    // Internal formats of 1-4 channels, for 8-bit, 16-bit and float channels
+    static const GLint formats[3][4] = {{GL_R8, GL_RG8, GL_RGB8, GL_RGBA8},
+                                        {GL_R16, GL_RG16, GL_RGB16, GL_RGBA16},
+                                        {GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F}};
+    static const GLint luminance_formats[3][2] = {{GL_LUMINANCE8, GL_LUMINANCE8_ALPHA8},
+                                                  {GL_LUMINANCE16, GL_LUMINANCE16_ALPHA16},
+                                                  {GL_LUMINANCE32F_ARB, GL_LUMINANCE_ALPHA32F_ARB}};
+    int depth = data_type == GL_UNSIGNED_SHORT ? 1 : data_type == GL_FLOAT ? 2 : 0;
+
+    switch (image.channels())
+    {
+    case 1:
+        if (swizzle)
+        {
+            return {formats[depth][0], GL_RED, data_type, {GL_RED, GL_RED, GL_RED, GL_ONE}};
+        }
+        return {luminance_formats[depth][0], GL_LUMINANCE, data_type, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}};
+    case 2:
+        if (swizzle)
+        {
+            return {formats[depth][1], GL_RG, data_type, {GL_RED, GL_RED, GL_RED, GL_GREEN}};
+        }
+        return {luminance_formats[depth][1], GL_LUMINANCE_ALPHA, data_type, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}};
+    case 4:
+        return {formats[depth][3], GL_BGRA, data_type, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}};
+    default:
+        return {formats[depth][2], GL_BGR, data_type, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}};
+    }
+}
+
+//---------------------- YUV CONVERSION ------------------------
+
+GLuint yuv_program = 0;      ///< Shader program converting I420 planes to RGB, shared by all windows
+GLuint yuv_vertex_array = 0; ///< Empty vertex array for drawing with the program (vertices come from gl_VertexID)
+
+/// Draws a quad over the whole framebuffer, without any vertex data
+static const char *yuv_vertex_shader = GLSL_VERSION R"(
+out vec2 uv;
+void main()
+{
+    uv = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+/// Converts full range BT.601 YCbCr (as in JPEG) to RGB, upsampling the chroma planes with the texture filtering
+static const char *yuv_fragment_shader = GLSL_VERSION R"(
+in vec2 uv;
+out vec4 color;
+uniform sampler2D y_plane;
+uniform sampler2D u_plane;
+uniform sampler2D v_plane;
+void main()
+{
+    float y = texture(y_plane, uv).r;
+    float u = texture(u_plane, uv).r - 0.5;
+    float v = texture(v_plane, uv).r - 0.5;
+    color = vec4(y + 1.402 * v, y - 0.344136 * u - 0.714136 * v, y + 1.772 * u, 1.0);
+}
+)";
+
+/**
+ * Compiles the shader
+ *
+ * @param type Type of the shader
+ * @param source Source code
+ *
+ * @returns Compiled shader
+ */
+static GLuint compileShader(GLenum type, const char *source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint compiled;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        glDeleteShader(shader);
+        throw StreamException(std::string("Cannot compile the YUV conversion shader: ") + log);
+    }
+    return shader;
+}
+
+/**
+ * Returns the program converting I420 planes to RGB, linking it on the first call
+ *
+ * @returns Shader program
+ */
+static GLuint getYuvProgram()
+{
+    if (yuv_program == 0)
+    {
+        GLuint vertex_shader = compileShader(GL_VERTEX_SHADER, yuv_vertex_shader);
+        GLuint fragment_shader = compileShader(GL_FRAGMENT_SHADER, yuv_fragment_shader);
+        yuv_program = glCreateProgram();
+        glAttachShader(yuv_program, vertex_shader);
+        glAttachShader(yuv_program, fragment_shader);
+        glBindFragDataLocation(yuv_program, 0, "color");
+        glLinkProgram(yuv_program);
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+
+        glUseProgram(yuv_program);
+        glUniform1i(glGetUniformLocation(yuv_program, "y_plane"), 0);
+        glUniform1i(glGetUniformLocation(yuv_program, "u_plane"), 1);
+        glUniform1i(glGetUniformLocation(yuv_program, "v_plane"), 2);
+        glGenVertexArrays(1, &yuv_vertex_array);
+    }
+    return yuv_program;
+}
+
 /**
  * Client receives and shows streams
  */
@@ -30,21 +174,187 @@ void FrameWindow::reloadTexture()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img.cols, img.rows, 0, GL_BGR, GL_UNSIGNED_BYTE, img.data);
+    // Rows are copied tightly packed, even if their size isn't a multiple of 4
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    cv::Size size = imageSize();
+    // I420 planes are converted to an RGB texture
+    TextureFormat gl_format = getTextureFormat(img);
+    if (format == PixelFormat::I420)
+    {
+        gl_format = {GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}};
+    }
+    if (size.width != texture_width || size.height != texture_height || img.type() != texture_type ||
+        format != texture_format)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, gl_format.internal_format, size.width, size.height, 0, gl_format.format,
+                     gl_format.type, nullptr);
+        if (GLEW_VERSION_3_3 || GLEW_ARB_texture_swizzle)
+        {
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, gl_format.swizzle);
+        }
+        if (format == PixelFormat::I420)
+        {
+            if (planes[0] == 0)
+            {
+                glGenTextures(3, planes);
+                glGenFramebuffers(1, &framebuffer);
+            }
+            for (int plane = 0; plane < 3; plane++)
+            {
+                glBindTexture(GL_TEXTURE_2D, planes[plane]);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                int divisor = plane == 0 ? 1 : 2;
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size.width / divisor, size.height / divisor, 0, GL_RED,
+                             GL_UNSIGNED_BYTE, nullptr);
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glBindTexture(GL_TEXTURE_2D, texture);
+        }
+        texture_width = size.width;
+        texture_height = size.height;
+        texture_type = img.type();
+        texture_format = format;
+    }
+
+    if (fillPixelBuffer())
+    {
+        if (format == PixelFormat::I420)
+        {
+            convertPlanes(size);
+        }
+        else
+        {
+            // With a pixel buffer bound, the last argument is an offset in it and the call returns without waiting
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.cols, img.rows, gl_format.format, gl_format.type, 0);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     IM_ASSERT(texture);
     changed = false;
+
+    if (captured.time_since_epoch().count() != 0)
+    {
+        // The sender's and our clocks have to be synchronized (e.g. with NTP or PTP) to get the true latency
+        float sample = std::chrono::duration<float, std::milli>(std::chrono::system_clock::now() - captured).count();
+        latency = latency == 0 ? sample : latency + (sample - latency) * SMOOTHING;
+    }
 }
 
-void FrameWindow::changeImg(cv::Mat &new_image)
+bool FrameWindow::fillPixelBuffer()
 {
-    if (new_image.channels() == 1)
+    if (pbos[0] == 0)
+    {
+        glGenBuffers(PBO_COUNT, pbos);
+    }
+    size_t row_size = img.cols * img.elemSize();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[next_pbo]);
+    next_pbo = (next_pbo + 1) % PBO_COUNT;
+    // Orphan the previous storage, so the driver doesn't wait for a transfer from it that is still running
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, row_size * img.rows, nullptr, GL_STREAM_DRAW);
+    uchar *buffer = (uchar *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, row_size * img.rows,
+                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!buffer)
     {
-        cv::cvtColor(new_image, img, cv::COLOR_GRAY2RGB);
+        return false;
+    }
+    if (img.isContinuous())
+    {
+        memcpy(buffer, img.data, row_size * img.rows);
     }
     else
     {
-        img = new_image;
+        for (int row = 0; row < img.rows; row++)
+        {
+            memcpy(buffer + row * row_size, img.ptr(row), row_size);
+        }
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return true;
+}
+
+void FrameWindow::convertPlanes(cv::Size size)
+{
+    // The planes follow each other in the buffer: Y of full size, then U and V of half the width and height
+    size_t offsets[3] = {0, (size_t)size.area(), (size_t)size.area() * 5 / 4};
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int divisor = plane == 0 ? 1 : 2;
+        glActiveTexture(GL_TEXTURE0 + plane);
+        glBindTexture(GL_TEXTURE_2D, planes[plane]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.width / divisor, size.height / divisor, GL_RED,
+                        GL_UNSIGNED_BYTE, (void *)offsets[plane]);
+    }
+
+    // Draw the converted image to the texture
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, size.width, size.height);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    glUseProgram(getYuvProgram());
+    glBindVertexArray(yuv_vertex_array);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // Leave the state as Dear ImGui expects it
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void TimeSeries::add(float ms)
+{
+    samples[next] = ms;
+    next = (next + 1) % TIME_SAMPLES;
+    count = std::min(count + 1, TIME_SAMPLES);
+}
+
+float TimeSeries::mean() const
+{
+    float sum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        sum += samples[i];
+    }
+    return count ? sum / count : 0;
+}
+
+float TimeSeries::max() const { return count ? *std::max_element(samples, samples + count) : 0; }
+
+void TimeSeries::plot(const char *label, ImVec2 size) const
+{
+    // Until the ring is full, the durations start at 0
+    ImGui::PlotLines(label, samples, count, count == TIME_SAMPLES ? next : 0, nullptr, 0, FLT_MAX, size);
+}
+
+void FrameWindow::changeFrame(Frame &frame)
+{
+    changeImg(frame.img);
+    format = frame.format;
+    if (frame.timestamps.decoded.time_since_epoch().count() != 0)
+    {
+        float sample =
+            std::chrono::duration<float, std::milli>(frame.timestamps.decoded - frame.timestamps.reassembled).count();
+        decode_time = decode_time == 0 ? sample : decode_time + (sample - decode_time) * SMOOTHING;
+    }
+    if (previous.time_since_epoch().count() != 0)
+    {
+        float sample = std::chrono::duration<float, std::milli>(frame.timestamps.captured - previous).count();
+        interval = interval == 0 ? sample : interval + (sample - interval) * SMOOTHING;
     }
+    previous = frame.timestamps.captured;
+    captured = frame.timestamps.captured;
+}
+
+void FrameWindow::changeImg(cv::Mat &new_image)
+{
+    img = new_image;
+    format = PixelFormat::NATIVE;
     changed = true;
 }
 
@@ -69,39 +379,118 @@ void FrameWindow::aspectRatio(ImGuiSizeCallbackData *data)
         data->DesiredSize.y = data->CurrentSize.y;
     }
 }
-void FrameWindow::display()
+void FrameWindow::display(bool *open)
 {
     ImGuiStyle &style = ImGui::GetStyle();
     // imGui doesn't provide setWindowContentSize method, so the content area is smaller than the image and the bottom
     // of the image is cut. To avoid this, we create a bigger window
     const int title_bar_size = style.FramePadding.y * 2 + ImGui::GetFontSize();
     // To reduce flickering, we round the aspect ratio to 1 decimal place
-    float aspect_ratio = round((float)img.cols / (float)img.rows * 10) / 10;
+    cv::Size size = imageSize();
+    float aspect_ratio = round((float)size.width / (float)size.height * 10) / 10;
     ImVec2 offset = ImVec2(style.WindowPadding.x * 2, style.WindowPadding.y * 2 + title_bar_size);
     struct WindowData window_options = {aspect_ratio, offset};
     if (changed)
     {
-        reloadTexture();
-        ImGui::SetNextWindowSize(ImVec2(img.cols + offset.x, img.cols / aspect_ratio + offset.y),
+        ImGui::SetNextWindowSize(ImVec2(size.width + offset.x, size.width / aspect_ratio + offset.y),
                                  ImGuiCond_FirstUseEver);
     }
     ImGui::SetNextWindowSizeConstraints(ImVec2(0, 0), ImVec2(FLT_MAX, FLT_MAX), aspectRatio, (void *)&window_options);
 
-    ImGui::Begin(name.c_str(), NULL, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
+    // The part after ### is the window's id, so the title can change
+    char title[256];
+    snprintf(title, sizeof(title), "%s – latency %.1f ms, interval %.1f ms###%s", name.c_str(), latency, interval,
+             name.c_str());
+    // Begin returns false for collapsed windows
+    visible = ImGui::Begin(title, open, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse);
     ImVec2 view = ImGui::GetWindowSize();
-    ImGui::Image((void *)(intptr_t)texture, ImVec2(view.x - offset.x, view.y - offset.y));
-
     ImVec2 pos = ImGui::GetWindowPos();
+    ImVec2 screen = ImGui::GetIO().DisplaySize;
+    visible = visible && pos.x < screen.x && pos.y < screen.y && pos.x + view.x > 0 && pos.y + view.y > 0;
+    if (visible)
+    {
+        if (changed)
+        {
+            auto start = std::chrono::steady_clock::now();
+            reloadTexture();
+            auto end = std::chrono::steady_clock::now();
+            float sample = std::chrono::duration<float, std::milli>(end - start).count();
+            upload_time = upload_time == 0 ? sample : upload_time + (sample - upload_time) * SMOOTHING;
+            if (reloaded.time_since_epoch().count() != 0)
+            {
+                frame_times.add(std::chrono::duration<float, std::milli>(end - reloaded).count());
+            }
+            reloaded = end;
+        }
+        ImVec2 corner = ImGui::GetCursorScreenPos();
+        ImGui::Image((void *)(intptr_t)texture, ImVec2(view.x - offset.x, view.y - offset.y));
+        if (overlay)
+        {
+            displayOverlay(corner);
+        }
+        if (ImGui::BeginPopupContextWindow())
+        {
+            ImGui::MenuItem("Performance overlay", nullptr, &overlay);
+            ImGui::EndPopup();
+        }
+    }
+
     ImGui::SetNextWindowPos(ImVec2(pos.x + title_bar_size, pos.y + title_bar_size), ImGuiCond_FirstUseEver);
     ImGui::End();
 }
 
+void FrameWindow::updateStats(const ReceiverStreamSnapshot &new_stats)
+{
+    uint64_t parts = new_stats.packets - stats.packets;
+    uint64_t lost = new_stats.lost_parts - stats.lost_parts;
+    loss = parts + lost ? 100.0f * lost / (parts + lost) : 0;
+    incomplete_frames =
+        new_stats.dropped_frames - stats.dropped_frames + new_stats.evicted_frames - stats.evicted_frames;
+    missing_frames = new_stats.missing_frames - stats.missing_frames;
+    stats = new_stats;
+}
+
+void FrameWindow::displayOverlay(ImVec2 corner)
+{
+    // The text is drawn to the upper channel, so its background can be added below it once its size is known
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+    draw_list->ChannelsSplit(2);
+    draw_list->ChannelsSetCurrent(1);
+    ImGui::SetCursorScreenPos(ImVec2(corner.x + OVERLAY_PADDING, corner.y + OVERLAY_PADDING));
+    ImGui::BeginGroup();
+    float frame_time = frame_times.mean();
+    ImGui::Text("decoded %.1f fps, displayed %.1f fps", stats.fps, frame_time ? 1000 / frame_time : 0);
+    ImGui::Text("lost %.1f%% of parts, %llu incomplete and %llu missing frames", loss,
+                (unsigned long long)incomplete_frames, (unsigned long long)missing_frames);
+    ImGui::Text("decoding %.2f ms, upload %.2f ms", decode_time, upload_time);
+    ImGui::Text("latency %.1f ms", latency);
+    ImGui::Text("frame time %.1f ms (max %.1f ms)", frame_time, frame_times.max());
+    frame_times.plot("##frame times", ImVec2(0, 40));
+    ImGui::EndGroup();
+
+    ImVec2 start = ImGui::GetItemRectMin();
+    ImVec2 end = ImGui::GetItemRectMax();
+    draw_list->ChannelsSetCurrent(0);
+    draw_list->AddRectFilled(ImVec2(start.x - OVERLAY_PADDING, start.y - OVERLAY_PADDING),
+                             ImVec2(end.x + OVERLAY_PADDING, end.y + OVERLAY_PADDING), IM_COL32(0, 0, 0, 160));
+    draw_list->ChannelsMerge();
+}
+
 FrameWindow::~FrameWindow()
 {
     if (texture != -1)
     {
         glDeleteTextures(1, &texture);
     }
+    if (pbos[0] != 0)
+    {
+        glDeleteBuffers(PBO_COUNT, pbos);
+    }
+    if (planes[0] != 0)
+    {
+        glDeleteTextures(3, planes);
+        glDeleteFramebuffers(1, &framebuffer);
+    }
 }
 
 //--------------------------- GUI ------------------------------
@@ -124,7 +513,7 @@ void initGui()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
 }
 
-GLFWwindow *createWindow(std::string name)
+GLFWwindow *createWindow(std::string name, bool vsync)
 {
     // Create window with graphics context
     const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
@@ -134,7 +523,13 @@ GLFWwindow *createWindow(std::string name)
         throw StreamException("Cannot create window");
     }
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(1); // Enable vsync
+    glfwSwapInterval(vsync ? 1 : 0);
+
+    // Load the OpenGL functions newer than 1.1 (e.g. pixel buffers)
+    if (glewInit() != GLEW_OK)
+    {
+        throw StreamException("Cannot initialize glew");
+    }
 
     return window;
 }
@@ -170,6 +565,12 @@ void render(GLFWwindow *window)
 
 void cleanUp(GLFWwindow *window)
 {
+    if (yuv_program != 0)
+    {
+        glDeleteProgram(yuv_program);
+        glDeleteVertexArrays(1, &yuv_vertex_array);
+    }
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -1,62 +1,460 @@
 #include "farshow/streamexception.hpp"
 
 #include "farshow/client.hpp"
+#include "farshow/framerecorder.hpp"
+#include "farshow/jpegdecoder.hpp"
+#include "farshow/streamwall.hpp"
+#include "farshow/triplebuffer.hpp"
 
 #include "cxxopts/cxxopts.hpp"
 #include "imgui/backends/imgui_impl_glfw.h"
 #include "imgui/backends/imgui_impl_opengl3.h"
 #include <GLFW/glfw3.h>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
 #include <opencv2/imgproc.hpp>
+#include <pthread.h>
 #include <thread>
+#include <unordered_set>
 
 #define GLSL_VERSION "#version 130"
+#define IDLE_TIMEOUT 0.5   ///< longest wait for events in seconds, when the window is redrawn on demand
+#define INPUT_REDRAWS 3    ///< number of redraws after input, as Dear ImGui reacts to some of it a frame later
+#define STATS_INTERVAL 0.5 ///< how often the performance panel and overlays get new statistics in seconds
 
 /**
  * Configuration of current program execution
  */
 typedef struct Config
 {
-    std::string ip = ""; ///< my ip address
-    int port = 1100;     ///< my port
+    std::string ip = "";    ///< my ip address
+    int port = 1100;        ///< my port
+    bool yuv = true;        ///< if JPEG frames are decoded to YUV planes and converted to RGB by the GPU
+    bool on_demand = false; ///< if the window is redrawn only on new frames and input, instead of every refresh
+    bool vsync = true;      ///< if buffer swaps wait for the display refresh
+    bool wall = false;      ///< if all streams are shown in a grid, instead of separate windows
+    /// maximum decode rates mapped to stream names (the empty name is the default, the display refresh rate if unset)
+    std::unordered_map<std::string, float> decode_rates;
+    bool headless = false;       ///< if frames are received and decoded without showing them
+    unsigned stats_interval = 1; ///< how often to print statistics in the headless mode, in seconds (0 turns them off)
+    std::string output = "";     ///< file to write the encoded frames to in the headless mode ("-" for stdout)
+    std::string record = "";     ///< directory to record the streams to in the headless mode
 } Config;
 
-std::unordered_map<std::string, farshow::FrameWindow> frames; ///< Most recent frames from all streams
-std::mutex frames_mutex; ///< Mutex for `frames` map. The map is used by main and receiver thread
-int socket_id;           ///< Socket on which messages from servers are received
+/**
+ * Frames of a stream decoded in the headless mode since the last statistics
+ */
+typedef struct DecodedCounters
+{
+    unsigned long frames = 0;  ///< number of decoded frames
+    double latency_ms = 0;     ///< sum of the times from capturing the frames to decoding them in ms
+    double max_latency_ms = 0; ///< longest time from capturing a frame to decoding it in ms
+} DecodedCounters;
+
+/**
+ * Measurements of the client shown in the performance panel
+ */
+typedef struct ClientPerformance
+{
+    farshow::TimeSeries frame_times;               ///< times between the redraws of the window in ms
+    farshow::TimeSeries loop_times;                ///< times of taking the frames and rendering them in ms
+    clockid_t receiver_clock;                      ///< CPU-time clock of the receiving thread
+    bool has_receiver_clock = false;               ///< if `receiver_clock` is available
+    std::chrono::nanoseconds receiver_cpu_time{0}; ///< CPU time of the receiving thread at the last update
+    float receiver_load = 0;                       ///< percentage of time the receiving thread ran on a CPU
+    std::chrono::steady_clock::time_point updated; ///< when the statistics were last updated
+} ClientPerformance;
+
+typedef farshow::TripleBuffer<farshow::Frame> FrameBuffer; ///< Newest frame of a stream, passed without locking
+
+std::unordered_map<std::string, farshow::FrameWindow> frames;   ///< Windows of all streams, used only by main thread
+std::vector<std::pair<std::string, FrameBuffer *>> new_streams; ///< Streams not yet seen by main thread
+std::atomic<bool> has_new_streams = false;                      ///< If `new_streams` isn't empty
+std::mutex new_streams_mutex;                                   ///< Guards `new_streams`, locked only for new streams
+std::unordered_set<std::string> hidden_streams;                 ///< Streams not decoded, as their windows are hidden
+std::unique_ptr<farshow::StreamWall> wall;                      ///< Grid of all streams in the wall mode
+std::atomic<bool> wakeup_pending = false;                       ///< If main thread was woken up for untaken frames
+int pending_redraws = INPUT_REDRAWS;                            ///< Redraws still needed, used only by main thread
+int receiving_socket = -1;                                      ///< Socket shut down on ^C in the headless mode
+bool show_performance = false;                                  ///< If the performance panel is shown (toggled by F2)
+bool show_overlays = false;                                     ///< If new windows show their performance overlays
 
 /**
- * Receives frames and put them in the map
+ * Receives frames and publishes them in the buffers of their streams
  *
  * The function is ment to run in the separate thread.
  *
- * @param config Configuration from command line arguments
+ * @param receiver Receiver of the frames
  */
-void receiveFrames(Config config)
+void receiveFrames(farshow::FrameReceiver &receiver)
 {
-    farshow::FrameReceiver receiver(config.ip, config.port);
-    socket_id = receiver.getSocket();
+    std::unordered_map<std::string, std::unique_ptr<FrameBuffer>> buffers; ///< Buffers of all streams
     farshow::Frame frame;
 
     frame = receiver.receiveFrame();
     while (!frame.img.empty())
     {
-        // Place the new frame in the map
-        frames_mutex.lock();
-        try
+        auto buffer = buffers.find(frame.name);
+        if (buffer == buffers.end())
         {
-            frames.at(frame.name).changeImg(frame.img);
+            // The buffers live as long as the thread, main thread stops using them before joining it
+            buffer = buffers.emplace(frame.name, std::make_unique<FrameBuffer>()).first;
+            std::lock_guard<std::mutex> lock(new_streams_mutex);
+            new_streams.emplace_back(frame.name, buffer->second.get());
+            has_new_streams = true;
         }
-        catch (std::out_of_range e)
+        buffer->second->back() = std::move(frame);
+        buffer->second->publish();
+        // Wake up parent thread, once for all frames published before it takes them
+        if (!wakeup_pending.exchange(true))
         {
-            frames.insert({frame.name, farshow::FrameWindow(frame)});
+            glfwPostEmptyEvent();
         }
-        frames_mutex.unlock();
-        glfwPostEmptyEvent(); // to unblock parent thread
 
         frame = receiver.receiveFrame();
     }
 }
 
+/**
+ * Takes the newest frames of all streams and creates windows for new ones
+ *
+ * @param buffers Buffers of the streams with windows, indexed by stream name
+ *
+ * @returns True if any window changed
+ */
+bool takeFrames(std::unordered_map<std::string, FrameBuffer *> &buffers)
+{
+    bool changed = false;
+    wakeup_pending = false; // frames published from now on wake up the thread again
+    if (has_new_streams)
+    {
+        std::lock_guard<std::mutex> lock(new_streams_mutex);
+        for (auto &stream : new_streams)
+        {
+            buffers.insert(stream);
+        }
+        new_streams.clear();
+        has_new_streams = false;
+    }
+
+    for (auto &[name, buffer] : buffers)
+    {
+        if (!buffer->update())
+        {
+            continue;
+        }
+        if (wall)
+        {
+            wall->changeFrame(buffer->front());
+            changed = true;
+            continue;
+        }
+        auto window = frames.find(name);
+        if (window == frames.end())
+        {
+            window = frames.emplace(name, farshow::FrameWindow(buffer->front())).first;
+            window->second.showOverlay(show_overlays);
+        }
+        else
+        {
+            window->second.changeFrame(buffer->front());
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+/**
+ * Schedules redraws of the window on its input events. Has to be called before `setupDearImGui`, which passes the
+ * events on to these callbacks.
+ *
+ * @param window Window of the client
+ */
+void watchInput(GLFWwindow *window)
+{
+    glfwSetCursorPosCallback(window, [](GLFWwindow *, double, double) { pending_redraws = INPUT_REDRAWS; });
+    glfwSetCursorEnterCallback(window, [](GLFWwindow *, int) { pending_redraws = INPUT_REDRAWS; });
+    glfwSetMouseButtonCallback(window, [](GLFWwindow *, int, int, int) { pending_redraws = INPUT_REDRAWS; });
+    glfwSetScrollCallback(window, [](GLFWwindow *, double, double) { pending_redraws = INPUT_REDRAWS; });
+    glfwSetKeyCallback(window,
+                       [](GLFWwindow *, int key, int, int action, int)
+                       {
+                           pending_redraws = INPUT_REDRAWS;
+                           if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+                           {
+                               show_performance = !show_performance;
+                           }
+                       });
+    glfwSetCharCallback(window, [](GLFWwindow *, unsigned) { pending_redraws = INPUT_REDRAWS; });
+    glfwSetWindowFocusCallback(window, [](GLFWwindow *, int) { pending_redraws = INPUT_REDRAWS; });
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow *, int, int) { pending_redraws = INPUT_REDRAWS; });
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow *) { pending_redraws = INPUT_REDRAWS; });
+}
+
+/**
+ * Tells the receiver which streams have visible windows, so frames of the others aren't decoded. Shows the newest
+ * frame kept by the receiver in a window, which became visible.
+ *
+ * @param receiver Receiver of the frames
+ * @param buffers Buffers of the streams with windows, indexed by stream name
+ * @param iconified If the client's window is iconified (and no stream is visible)
+ */
+void updateVisibility(farshow::FrameReceiver &receiver, std::unordered_map<std::string, FrameBuffer *> &buffers,
+                      bool iconified)
+{
+    for (auto &[name, window] : frames)
+    {
+        bool visible = window.isVisible() && !iconified;
+        auto hidden = hidden_streams.find(name);
+        if (!visible && hidden == hidden_streams.end())
+        {
+            receiver.setStreamVisible(name, false);
+            hidden_streams.insert(name);
+        }
+        else if (visible && hidden != hidden_streams.end())
+        {
+            hidden_streams.erase(hidden);
+            std::optional<farshow::Frame> frame = receiver.setStreamVisible(name, true);
+            if (frame && !frame->img.empty())
+            {
+                buffers[name]->update(); // drop a frame decoded before the stream was hidden
+                window.changeFrame(*frame);
+                pending_redraws = std::max(pending_redraws, 1);
+            }
+        }
+    }
+}
+
+/**
+ * Updates the load of the receiving thread and the reception statistics of the windows, once per STATS_INTERVAL
+ *
+ * @param receiver Receiver of the frames
+ * @param performance Measurements of the client
+ */
+void updateStats(farshow::FrameReceiver &receiver, ClientPerformance &performance)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - performance.updated < std::chrono::duration<double>(STATS_INTERVAL))
+    {
+        return;
+    }
+
+    timespec cpu;
+    if (performance.has_receiver_clock && clock_gettime(performance.receiver_clock, &cpu) == 0)
+    {
+        auto cpu_time = std::chrono::seconds(cpu.tv_sec) + std::chrono::nanoseconds(cpu.tv_nsec);
+        performance.receiver_load = 100.0 * (cpu_time - performance.receiver_cpu_time) / (now - performance.updated);
+        performance.receiver_cpu_time = cpu_time;
+    }
+    performance.updated = now;
+
+    for (auto &[name, stats] : receiver.getStreamStats())
+    {
+        auto window = frames.find(name);
+        if (window != frames.end())
+        {
+            window->second.updateStats(stats);
+        }
+    }
+}
+
+/**
+ * Prepares the Dear ImGui window with the performance of the render loop and the receiving thread
+ *
+ * @param performance Measurements of the client
+ */
+void displayPerformance(ClientPerformance &performance)
+{
+    ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Performance", &show_performance, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        float frame_time = performance.frame_times.mean();
+        ImGui::Text("render loop: %.1f fps, frame time %.1f ms (max %.1f ms)", frame_time ? 1000 / frame_time : 0,
+                    frame_time, performance.frame_times.max());
+        performance.frame_times.plot("##frame times", ImVec2(0, 40));
+        ImGui::Text("loop time (without waiting for events): %.2f ms (max %.2f ms)", performance.loop_times.mean(),
+                    performance.loop_times.max());
+        ImGui::Text("receiving thread: %.0f%% of a CPU", performance.receiver_load);
+        if (ImGui::Checkbox("Overlays on all windows", &show_overlays))
+        {
+            for (auto &f : frames)
+            {
+                f.second.showOverlay(show_overlays);
+            }
+        }
+    }
+    ImGui::End();
+}
+
+//------------------ HEADLESS MODE ----------------------
+/**
+ * Prints the statistics of all streams periodically: decoded frames per second, latency from capture to decoding,
+ * decoding time, lost parts and incomplete (dropped or evicted) frames since the previous print
+ *
+ * @param receiver Receiver of the frames
+ * @param decoded Frames decoded since the previous print, indexed by stream name (cleared by the function)
+ * @param decoded_mutex Guards `decoded`
+ * @param interval Time between the prints
+ * @param out Stream to print to
+ * @param running Cleared when the client stops
+ */
+void printStats(farshow::FrameReceiver &receiver, std::unordered_map<std::string, DecodedCounters> &decoded,
+                std::mutex &decoded_mutex, std::chrono::seconds interval, std::ostream &out,
+                std::atomic<bool> &running)
+{
+    std::unordered_map<std::string, farshow::ReceiverStreamSnapshot> previous;
+    uint64_t previous_kernel_drops = 0;
+    auto next = std::chrono::steady_clock::now() + interval;
+    while (running)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() < next)
+        {
+            continue;
+        }
+        next += interval;
+
+        std::unordered_map<std::string, DecodedCounters> counters;
+        {
+            std::lock_guard<std::mutex> lock(decoded_mutex);
+            std::swap(counters, decoded);
+        }
+        std::unordered_map<std::string, farshow::ReceiverStreamSnapshot> current = receiver.getStreamStats();
+        for (auto &[name, stats] : current)
+        {
+            farshow::ReceiverStreamSnapshot &last = previous[name];
+            if (stats.packets == last.packets)
+            {
+                continue; // the stream has stopped
+            }
+            DecodedCounters &frames = counters[name];
+            uint64_t parts = stats.packets - last.packets;
+            uint64_t lost = stats.lost_parts - last.lost_parts;
+            uint64_t decodes = stats.decode_time.count - last.decode_time.count;
+            out << std::fixed << std::setprecision(1) << name << ": " << frames.frames / (double)interval.count()
+                << " fps, latency " << (frames.frames ? frames.latency_ms / frames.frames : 0) << " ms (max "
+                << frames.max_latency_ms << " ms), decoding "
+                << (decodes ? (stats.decode_time.total_us - last.decode_time.total_us) / 1000.0 / decodes : 0)
+                << " ms, lost " << 100.0 * lost / (parts + lost) << "% of parts, "
+                << stats.dropped_frames - last.dropped_frames + stats.evicted_frames - last.evicted_frames
+                << " incomplete and " << stats.missing_frames - last.missing_frames << " missing frames";
+            if (stats.skipped_frames != last.skipped_frames)
+            {
+                out << ", " << stats.skipped_frames - last.skipped_frames << " skipped by the decode rate limit";
+            }
+            out << std::endl;
+        }
+        uint64_t kernel_drops = receiver.getReassemblyStats().kernel_drops;
+        if (kernel_drops != previous_kernel_drops)
+        {
+            out << "dropped by the kernel: " << kernel_drops - previous_kernel_drops << " datagrams" << std::endl;
+            previous_kernel_drops = kernel_drops;
+        }
+        previous = std::move(current);
+    }
+}
+
+/**
+ * Receives and decodes the frames like the windowed client, but without a window – only printing statistics and
+ * optionally writing the encoded frames to a file or recording them. Runs until ^C.
+ *
+ * @param config Configuration of the client
+ */
+void runHeadless(const Config &config)
+{
+    farshow::FrameReceiver receiver(config.ip, config.port); ///< receiver of the frames from servers
+    if (config.yuv)
+    {
+        receiver.setDecoder(farshow::decodeJpegYuv);
+    }
+    for (auto &rate : config.decode_rates)
+    {
+        receiver.setMaxDecodeRate(rate.first, rate.second);
+    }
+
+    // Encoded frames are written from the receiving thread, one after another (e.g. an MJPEG stream for ffmpeg)
+    FILE *output = nullptr;
+    if (!config.output.empty())
+    {
+        output = config.output == "-" ? stdout : fopen(config.output.c_str(), "wb");
+        if (!output)
+        {
+            throw farshow::StreamException("Cannot open " + config.output, errno);
+        }
+        receiver.subscribeEncoded("", [output](const farshow::EncodedFrame &frame)
+                                  { fwrite(frame.data, 1, frame.size, output); });
+    }
+    std::unique_ptr<farshow::FrameRecorder> recorder;
+    if (!config.record.empty())
+    {
+        recorder = std::make_unique<farshow::FrameRecorder>(config.record);
+        receiver.subscribeEncoded("", [&recorder](const farshow::EncodedFrame &frame) { recorder->record(frame); });
+    }
+
+    std::unordered_map<std::string, DecodedCounters> decoded; ///< frames decoded since the last statistics
+    std::mutex decoded_mutex;
+    receiver.subscribe("",
+                       [&decoded, &decoded_mutex](farshow::Frame &frame)
+                       {
+                           std::chrono::duration<double, std::milli> latency =
+                               frame.timestamps.decoded - frame.timestamps.captured;
+                           std::lock_guard<std::mutex> lock(decoded_mutex);
+                           DecodedCounters &counters = decoded[frame.name];
+                           counters.frames++;
+                           counters.latency_ms += latency.count();
+                           counters.max_latency_ms = std::max(counters.max_latency_ms, latency.count());
+                       });
+
+    std::atomic<bool> running = true;
+    std::thread stats;
+    if (config.stats_interval)
+    {
+        // Statistics don't mix with the frames written to stdout
+        std::ostream &out = output == stdout ? std::cerr : std::cout;
+        stats = std::thread(printStats, std::ref(receiver), std::ref(decoded), std::ref(decoded_mutex),
+                            std::chrono::seconds(config.stats_interval), std::ref(out), std::ref(running));
+    }
+    auto stop_stats = [&running, &stats]()
+    {
+        running = false;
+        if (stats.joinable())
+        {
+            stats.join();
+        }
+    };
+    receiving_socket = receiver.getSocket();
+    try
+    {
+        receiver.run();
+    }
+    catch (...)
+    {
+        // A joinable thread would terminate the program before the error is printed
+        stop_stats();
+        throw;
+    }
+    stop_stats();
+
+    if (output)
+    {
+        fflush(output);
+        if (output != stdout)
+        {
+            fclose(output);
+        }
+    }
+}
+
+void signalHandler(int signum)
+{
+    if (receiving_socket != -1)
+    {
+        shutdown(receiving_socket, SHUT_RDWR);
+    }
+}
+
 //------------------ COMMAND LINE OPTIONS ----------------------
 /**
  * Parses command line options
@@ -70,6 +468,9 @@ void receiveFrames(Config config)
 Config parseOptions(int argc, char const *argv[])
 {
     Config config;
+    bool no_yuv;
+    bool no_vsync;
+    std::vector<std::string> decode_rates;
     cxxopts::ParseResult result;
 
     // Set available options
@@ -80,6 +481,24 @@ Config parseOptions(int argc, char const *argv[])
     options.add_options()
         ("i, ip", "IP address to which the stream was sent", cxxopts::value(config.ip))
         ("p, port", "Port to which stream was sent", cxxopts::value(config.port)->default_value("1100"))
+        ("no-yuv", "Decode JPEG frames to BGR on the CPU, instead of converting their YUV planes on the GPU",
+                cxxopts::value(no_yuv)->default_value("false"))
+        ("on-demand", "Redraw the window only when a frame arrives or on input, instead of every display refresh",
+                cxxopts::value(config.on_demand)->default_value("false"))
+        ("no-vsync", "Don't wait for the display refresh with showing a frame, for the lowest latency",
+                cxxopts::value(no_vsync)->default_value("false"))
+        ("wall", "Show all streams in a grid, decoding them downscaled – a clicked stream opens in full resolution",
+                cxxopts::value(config.wall)->default_value("false"))
+        ("d, decode-rate", "Maximum number of frames decoded per second, for all streams (RATE) or one of them "
+                "(NAME=RATE), 0 for no limit. The display refresh rate by default", cxxopts::value(decode_rates))
+        ("headless", "Receive and decode the frames without a window, printing statistics of the streams",
+                cxxopts::value(config.headless)->default_value("false"))
+        ("s, stats", "Print statistics every this many seconds in the headless mode (0 turns them off)",
+                cxxopts::value(config.stats_interval)->default_value("1"))
+        ("o, output", "Write the encoded frames one after another to this file in the headless mode (- for stdout)",
+                cxxopts::value(config.output))
+        ("r, record", "Record the streams to this directory in the headless mode (see farshow-replay)",
+                cxxopts::value(config.record))
         ("h, help", "Print usage");
     // clang-format on
 
@@ -103,6 +522,27 @@ Config parseOptions(int argc, char const *argv[])
         exit(0);
     }
 
+    config.yuv = !no_yuv;
+    config.vsync = !no_vsync;
+    for (const std::string &rate : decode_rates)
+    {
+        size_t separator = rate.rfind('=');
+        std::string name = separator == std::string::npos ? "" : rate.substr(0, separator);
+        try
+        {
+            config.decode_rates[name] = std::stof(rate.substr(separator == std::string::npos ? 0 : separator + 1));
+        }
+        catch (std::logic_error &e)
+        {
+            std::cerr << "\033[31mInvalid decode rate: " << rate << "\033[0m" << std::endl;
+            exit(1);
+        }
+    }
+    if (!config.headless && (!config.output.empty() || !config.record.empty()))
+    {
+        std::cerr << "\033[31mFrames can be written only in the headless mode\033[0m" << std::endl;
+        exit(1);
+    }
     return config;
 }
 
@@ -112,37 +552,115 @@ int main(int argc, const char **argv)
 
     try
     {
+        if (config.headless)
+        {
+            signal(SIGINT, signalHandler);  ///< exit with ^C
+            signal(SIGTERM, signalHandler); ///< and when killed, e.g. by a benchmark's timeout
+            runHeadless(config);
+            return 0;
+        }
+
         farshow::initGui();
-        std::thread receiver_thread = std::thread(receiveFrames, config); ///< thread receiving messages from servers
-        GLFWwindow *window = farshow::createWindow("farshow");            ///< window for displaying the streams
+        farshow::FrameReceiver receiver(config.ip, config.port); ///< receiver of the frames from servers
+        if (config.wall)
+        {
+            wall = std::make_unique<farshow::StreamWall>(config.yuv ? farshow::decodeJpegYuv : farshow::FrameDecoder());
+            receiver.setDecoder([](const farshow::EncodedFrame &encoded, farshow::Frame &frame)
+                                { return wall->decode(encoded, frame); });
+        }
+        else if (config.yuv)
+        {
+            receiver.setDecoder(farshow::decodeJpegYuv);
+        }
+        std::thread receiver_thread = std::thread(receiveFrames, std::ref(receiver)); ///< thread receiving frames
+        GLFWwindow *window = farshow::createWindow("farshow", config.vsync);          ///< window showing the streams
+        watchInput(window);
         farshow::setupDearImGui(window);
 
+        ClientPerformance performance;                     ///< measurements shown in the performance panel
+        std::chrono::steady_clock::time_point last_render; ///< when the window was last redrawn
+        performance.has_receiver_clock =
+            pthread_getcpuclockid(receiver_thread.native_handle(), &performance.receiver_clock) == 0;
+        performance.updated = std::chrono::steady_clock::now();
+
+        // Frames arriving faster than the display refresh would be decoded only to be replaced before being shown
+        const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        if (!config.decode_rates.count("") && mode)
+        {
+            receiver.setMaxDecodeRate("", mode->refreshRate);
+        }
+        for (auto &rate : config.decode_rates)
+        {
+            receiver.setMaxDecodeRate(rate.first, rate.second);
+        }
+        std::unordered_map<std::string, FrameBuffer *> buffers; ///< Buffers of the streams known to main thread
+
         while (!glfwWindowShouldClose(window))
         {
-            glfwPollEvents();
+            if (config.on_demand && pending_redraws == 0)
+            {
+                // Sleep until a frame or input arrives (the timeout only guards against a missed wakeup)
+                glfwWaitEventsTimeout(IDLE_TIMEOUT);
+            }
+            else
+            {
+                glfwPollEvents();
+            }
+            auto loop_start = std::chrono::steady_clock::now();
+
+            if (takeFrames(buffers) && pending_redraws == 0)
+            {
+                pending_redraws = 1;
+            }
+            if (config.on_demand && pending_redraws == 0)
+            {
+                continue;
+            }
+            if (pending_redraws > 0)
+            {
+                pending_redraws--;
+            }
 
             // Display all streams
             ImGui_ImplOpenGL3_NewFrame();
             ImGui_ImplGlfw_NewFrame();
             ImGui::NewFrame();
 
-            frames_mutex.lock();
+            if (wall)
+            {
+                wall->display();
+            }
             for (auto &f : frames)
             {
                 f.second.display();
             }
-            frames_mutex.unlock();
+            updateStats(receiver, performance);
+            if (show_performance)
+            {
+                displayPerformance(performance);
+            }
 
             farshow::render(window);
+            updateVisibility(receiver, buffers, glfwGetWindowAttrib(window, GLFW_ICONIFIED));
+
+            auto loop_end = std::chrono::steady_clock::now();
+            performance.loop_times.add(std::chrono::duration<float, std::milli>(loop_end - loop_start).count());
+            if (last_render.time_since_epoch().count() != 0)
+            {
+                performance.frame_times.add(std::chrono::duration<float, std::milli>(loop_end - last_render).count());
+            }
+            last_render = loop_end;
         }
 
         std::cout << "Closing client...\n";
-        shutdown(socket_id, 2); // To stop the child thread, blocked on recv
+        shutdown(receiver.getSocket(), 2); // To stop the child thread, blocked on recv
         receiver_thread.join();
+        wall.reset();
         farshow::cleanUp(window);
     }
-    catch (farshow::StreamException &ex)
+    catch (std::exception &ex)
     {
+        // Also errors of decoding (cv::Exception) in the headless mode
         std::cerr << ex.what() << std::endl;
         std::cerr << "Closing farshow" << std::endl;
         return 1;
@@ -0,0 +1,928 @@
+#include "farshow/framereceiver.hpp"
+#include "farshow/framesender.hpp"
+#include "farshow/streamexception.hpp"
+
+// Routes list their streams with commas, so values of the repeated options mustn't be split on them
+#define CXXOPTS_VECTOR_DELIMITER '\0'
+#include "cxxopts/cxxopts.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * Receives streams and sends them again to other clients, without decoding the frames or with transcoding them to
+ * smaller renditions.
+ *
+ * Streams are routed to destinations (unicast, broadcast or multicast addresses) by their names. Frames are forwarded
+ * after reassembly (so only complete frames are sent further), or datagram by datagram as they come (raw mode).
+ * Destinations on thin links can get downscaled, lower quality renditions instead, made on a pool of workers.
+ */
+
+int receiving_socket = -1; ///< socket shut down on ^C, to stop receiving
+
+/**
+ * Destination of the forwarded streams
+ */
+typedef struct Route
+{
+    std::string address;              ///< ip address of the destination
+    int port;                         ///< port of the destination
+    std::vector<std::string> streams; ///< forwarded streams (all streams if empty)
+    double scale = 1;                 ///< scale of the rendition
+    int quality = 0;                  ///< JPEG quality of the rendition (0 forwards the frames as they are)
+} Route;
+
+/**
+ * Configuration of current program execution
+ */
+typedef struct Config
+{
+    std::string address;              ///< address to receive the streams on
+    int port;                         ///< port to receive the streams on
+    std::vector<Route> routes;        ///< where to forward the streams
+    std::vector<std::string> exclude; ///< streams which aren't forwarded anywhere
+    bool raw;                         ///< if the datagrams should be forwarded without reassembling frames
+    bool io_uring;                    ///< if the io_uring transport should be used
+    int ttl;                          ///< time to live of multicast datagrams
+    unsigned stats_interval;          ///< how often to print statistics in seconds (0 turns them off)
+    unsigned workers;                 ///< number of threads transcoding the frames
+} Config;
+
+/**
+ * Sender to one destination, which can forward both whole frames and single datagrams
+ */
+class Destination : public farshow::FrameSender
+{
+public:
+    /**
+     * Creates the socket, allowing broadcast destinations
+     *
+     * @param route Destination
+     * @param ttl Time to live of multicast datagrams
+     */
+    Destination(const Route &route, int ttl)
+        : FrameSender(route.address, route.port, 0), scale(route.scale), quality(route.quality)
+    {
+        int enable = 1;
+        setsockopt(mySocket, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+        if (IN_MULTICAST(ntohl(clientAddr.sin_addr.s_addr)))
+        {
+            setsockopt(mySocket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        }
+    }
+
+    /**
+     * Sends the datagram as it is
+     *
+     * @param data Datagram
+     * @param size Size of the datagram
+     */
+    void forwardDatagram(const char *data, size_t size)
+    {
+        sendDatagram(data, size);
+        flushDatagrams();
+        forwarded_datagrams++;
+    }
+
+    /**
+     * Tells if the destination gets renditions instead of the received frames
+     *
+     * @returns True if the frames are transcoded
+     */
+    bool isTranscoded() { return quality > 0; }
+
+    const double scale;                                 ///< scale of the rendition
+    const int quality;                                  ///< JPEG quality of the rendition
+    std::mutex mutex;                                   ///< mutex for sending renditions from many workers
+    std::atomic<unsigned long> forwarded_datagrams = 0; ///< number of datagrams forwarded in raw mode
+};
+
+/**
+ * Receives datagrams without reassembling them (raw mode)
+ */
+class DatagramReceiver : public farshow::UdpInterface
+{
+public:
+    /**
+     * Creates and binds the socket
+     *
+     * @param address Address to bind to
+     * @param port Port to bind to
+     */
+    DatagramReceiver(std::string address, int port) : UdpInterface(address, port)
+    {
+        int enable = 1;
+        setsockopt(mySocket, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+        // Datagrams aren't joined, so the buffer needs room only for the bursts which come while forwarding
+        int buffer_size = 16 << 20;
+        if (setsockopt(mySocket, SOL_SOCKET, SO_RCVBUFFORCE, &buffer_size, sizeof(buffer_size)) == -1)
+        {
+            setsockopt(mySocket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+        }
+        if (bind(mySocket, (struct sockaddr *)&clientAddr, sizeof(clientAddr)) == -1)
+        {
+            close(mySocket);
+            throw farshow::StreamException("Cannot bind", errno);
+        }
+    }
+
+    /**
+     * Waits for a datagram
+     *
+     * @param data Set to the received datagram, valid until the next call
+     *
+     * @returns Size of the datagram, 0 if the socket was shut down
+     */
+    size_t receive(const char *&data) { return receiveDatagram(data); }
+
+    /**
+     * Returns the socket
+     *
+     * @returns Socket
+     */
+    int getSocket() { return mySocket; }
+
+    /**
+     * Returns the number of datagrams dropped by the kernel
+     *
+     * @returns Number of dropped datagrams
+     */
+    unsigned long getKernelDrops() { return dropped_datagrams; }
+};
+
+/**
+ * Maps stream names to their destinations
+ */
+class Router
+{
+public:
+    /**
+     * Creates the destinations
+     *
+     * @param config Relay configuration
+     */
+    Router(Config &config) : exclude(config.exclude.begin(), config.exclude.end())
+    {
+        for (auto &route : config.routes)
+        {
+            destinations.push_back(std::make_unique<Destination>(route, config.ttl));
+            Destination *destination = destinations.back().get();
+            if (config.io_uring)
+            {
+                destination->setTransport(farshow::Transport::IO_URING);
+            }
+            if (route.streams.empty())
+            {
+                any_stream.push_back(destination);
+            }
+            for (auto &name : route.streams)
+            {
+                by_stream[name].push_back(destination);
+            }
+        }
+        // Streams with their own routes go also to the destinations of all streams
+        for (auto &stream : by_stream)
+        {
+            stream.second.insert(stream.second.end(), any_stream.begin(), any_stream.end());
+        }
+    }
+
+    /**
+     * Finds the destinations of the stream
+     *
+     * @param name Stream name
+     *
+     * @returns Destinations (empty if the stream isn't forwarded)
+     */
+    const std::vector<Destination *> &route(std::string_view name)
+    {
+        auto stream = by_stream.find(name);
+        if (stream != by_stream.end())
+        {
+            return stream->second;
+        }
+        return exclude.find(name) == exclude.end() ? any_stream : none;
+    }
+
+    /**
+     * Tells which streams should be received at all
+     *
+     * @param mode Set to the filter mode
+     * @param names Set to the filtered streams
+     */
+    void getFilter(farshow::FilterMode &mode, std::vector<std::string> &names)
+    {
+        if (any_stream.empty())
+        {
+            mode = farshow::FilterMode::ALLOW;
+            for (auto &stream : by_stream)
+            {
+                names.push_back(stream.first);
+            }
+        }
+        else
+        {
+            mode = farshow::FilterMode::DENY;
+            for (auto &name : exclude)
+            {
+                if (by_stream.find(name) == by_stream.end())
+                {
+                    names.push_back(name);
+                }
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Destination>> destinations; ///< all destinations
+
+private:
+    std::vector<Destination *> any_stream; ///< destinations of all streams
+    std::vector<Destination *> none;       ///< no destinations
+    /// Destinations of streams with their own routes
+    std::unordered_map<std::string, std::vector<Destination *>, farshow::StringHash, std::equal_to<>> by_stream;
+    farshow::StringSet exclude; ///< streams, which aren't forwarded to the destinations of all streams
+};
+
+/**
+ * Counters printed periodically
+ */
+typedef struct Counters
+{
+    unsigned long received;     ///< received frames (or datagrams)
+    unsigned long kernel_drops; ///< datagrams dropped by the kernel
+    unsigned long skipped;      ///< frames skipped by transcoding
+} Counters;
+
+/**
+ * Fixed set of threads running tasks in the order of submission
+ */
+class WorkerPool
+{
+public:
+    /**
+     * Starts the threads
+     *
+     * @param workers Number of threads
+     */
+    WorkerPool(unsigned workers)
+    {
+        for (unsigned i = 0; i < workers; i++)
+        {
+            threads.emplace_back(&WorkerPool::work, this);
+        }
+    }
+
+    /**
+     * Runs the remaining tasks and stops the threads
+     */
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        task_available.notify_all();
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    /**
+     * Queues the task
+     *
+     * @param task Task to run on one of the threads
+     */
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        task_available.notify_one();
+    }
+
+private:
+    /**
+     * Runs the queued tasks until the pool is stopped
+     */
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            task_available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return;
+            }
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    std::vector<std::thread> threads;        ///< worker threads
+    std::deque<std::function<void()>> tasks; ///< queued tasks
+    bool stopping = false;                   ///< if the threads should exit when the queue is empty
+    std::mutex mutex;                        ///< mutex for `tasks` and `stopping`
+    std::condition_variable task_available;  ///< notified when a task is queued or the pool is stopped
+};
+
+/**
+ * Decodes frames once and encodes downscaled renditions of them for the transcoded destinations.
+ *
+ * Work is pipelined over the worker pool: decoding the next frame of a stream runs alongside resizing and encoding the
+ * renditions of the previous one. When the workers can't keep up, a stream's frame waiting for decoding is replaced by
+ * a newer one, and a rendition older than the last one sent is dropped, so the destinations always get the latest
+ * frames in order.
+ */
+class Transcoder
+{
+public:
+    /**
+     * Starts the workers
+     *
+     * @param router Router with the destinations
+     * @param workers Number of worker threads
+     */
+    Transcoder(Router &router, unsigned workers) : router(router), pool(workers) {}
+
+    /**
+     * Queues the frame for transcoding, if any transcoded destination gets its stream
+     *
+     * @param frame Received frame
+     */
+    void push(const farshow::EncodedFrame &frame)
+    {
+        std::shared_ptr<Stream> stream = getStream(frame.name);
+        if (stream->renditions.empty())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(stream->mutex);
+        stream->pending.assign(frame.data, frame.data + frame.size);
+        stream->timestamps = frame.timestamps;
+        stream->sequence++;
+        if (stream->queued)
+        {
+            skipped_frames++;
+            return;
+        }
+        stream->queued = true;
+        pool.submit([this, stream]() { decode(stream); });
+    }
+
+    std::atomic<unsigned long> skipped_frames = 0; ///< frames replaced before being decoded, or renditions dropped
+
+private:
+    /**
+     * Frame encoded for the destinations with the same scale and quality
+     */
+    struct Rendition
+    {
+        double scale;                            ///< scale of the frame
+        int quality;                             ///< JPEG quality
+        std::vector<Destination *> destinations; ///< destinations getting the rendition
+        uint64_t sent_sequence = 0;              ///< sequence number of the last sent frame
+        std::mutex mutex;                        ///< mutex for sending in order
+    };
+
+    /**
+     * Transcoding state of a stream
+     */
+    struct Stream
+    {
+        std::string name;                                   ///< stream name
+        std::vector<std::unique_ptr<Rendition>> renditions; ///< renditions of the stream
+        std::vector<uchar> pending;                         ///< newest frame waiting for decoding
+        farshow::FrameTimestamps timestamps;                ///< timestamps of the pending frame
+        uint64_t sequence = 0;                              ///< sequence number of the pending frame
+        bool queued = false;                                ///< if decoding of the pending frame is queued
+        std::mutex mutex;                                   ///< mutex for the pending frame
+    };
+
+    /**
+     * Finds the state of the stream, creating it with its renditions on the first frame
+     *
+     * @param name Stream name
+     *
+     * @returns State of the stream
+     */
+    std::shared_ptr<Stream> getStream(std::string_view name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = streams.find(name);
+        if (found != streams.end())
+        {
+            return found->second;
+        }
+
+        auto stream = std::make_shared<Stream>();
+        stream->name = name;
+        for (Destination *destination : router.route(name))
+        {
+            if (!destination->isTranscoded())
+            {
+                continue;
+            }
+            // Destinations with the same settings share the rendition, so it's encoded once
+            auto same = std::find_if(stream->renditions.begin(), stream->renditions.end(),
+                                     [destination](auto &rendition)
+                                     {
+                                         return rendition->scale == destination->scale &&
+                                                rendition->quality == destination->quality;
+                                     });
+            if (same == stream->renditions.end())
+            {
+                stream->renditions.push_back(std::make_unique<Rendition>());
+                stream->renditions.back()->scale = destination->scale;
+                stream->renditions.back()->quality = destination->quality;
+                same = stream->renditions.end() - 1;
+            }
+            (*same)->destinations.push_back(destination);
+        }
+        streams.emplace(stream->name, stream);
+        return stream;
+    }
+
+    /**
+     * Decodes the pending frame of the stream and queues encoding of its renditions
+     *
+     * @param stream Stream to decode
+     */
+    void decode(std::shared_ptr<Stream> stream)
+    {
+        std::vector<uchar> encoded;
+        farshow::FrameTimestamps timestamps;
+        uint64_t sequence;
+        {
+            std::lock_guard<std::mutex> lock(stream->mutex);
+            encoded.swap(stream->pending);
+            timestamps = stream->timestamps;
+            sequence = stream->sequence;
+            stream->queued = false;
+        }
+
+        auto image = std::make_shared<cv::Mat>(cv::imdecode(encoded, cv::IMREAD_UNCHANGED));
+        if (image->empty())
+        {
+            return;
+        }
+        for (auto &rendition : stream->renditions)
+        {
+            pool.submit([this, stream, rendition = rendition.get(), image, timestamps, sequence]()
+                        { encode(*stream, *rendition, *image, timestamps, sequence); });
+        }
+    }
+
+    /**
+     * Resizes and encodes the frame and sends it to the destinations of the rendition, unless a newer one was sent
+     *
+     * @param stream Stream of the frame
+     * @param rendition Rendition to make
+     * @param image Decoded frame
+     * @param timestamps Timestamps of the received frame
+     * @param sequence Sequence number of the frame
+     */
+    void encode(Stream &stream, Rendition &rendition, const cv::Mat &image, farshow::FrameTimestamps timestamps,
+                uint64_t sequence)
+    {
+        cv::Mat resized = image;
+        if (rendition.scale != 1)
+        {
+            cv::resize(image, resized, cv::Size(), rendition.scale, rendition.scale, cv::INTER_AREA);
+        }
+        std::vector<uchar> encoded;
+        cv::imencode(".jpg", resized, encoded, {cv::IMWRITE_JPEG_QUALITY, rendition.quality});
+        auto encode_time = std::chrono::system_clock::now();
+
+        std::lock_guard<std::mutex> lock(rendition.mutex);
+        if (sequence < rendition.sent_sequence)
+        {
+            skipped_frames++;
+            return;
+        }
+        rendition.sent_sequence = sequence;
+        for (Destination *destination : rendition.destinations)
+        {
+            std::lock_guard<std::mutex> destination_lock(destination->mutex);
+            try
+            {
+                destination->sendEncodedFrame(encoded.data(), encoded.size(), stream.name, timestamps.captured,
+                                              encode_time);
+            }
+            catch (farshow::StreamException &e)
+            {
+                std::cerr << "\033[31m" << e.what() << "\033[0m" << std::endl;
+            }
+        }
+    }
+
+    Router &router; ///< router with the destinations
+    /// Transcoding state of the streams
+    std::unordered_map<std::string, std::shared_ptr<Stream>, farshow::StringHash, std::equal_to<>> streams;
+    std::mutex mutex; ///< mutex for `streams`
+    WorkerPool pool;  ///< workers decoding and encoding the frames, destroyed first
+};
+
+/**
+ * Reads the stream name from the datagram
+ *
+ * @param data Datagram
+ * @param size Size of the datagram
+ *
+ * @returns Stream name, empty if the datagram is malformed or has another version of the header
+ */
+std::string_view getStreamName(const char *data, size_t size)
+{
+    const farshow::FrameHeader *header = (const farshow::FrameHeader *)data;
+    if (size < sizeof(farshow::FrameHeader) || header->magic != FRAME_MAGIC || header->version != FRAME_VERSION ||
+        header->name_length == 0 || header->name_length > size - sizeof(farshow::FrameHeader))
+    {
+        return std::string_view();
+    }
+    const char *name = data + sizeof(farshow::FrameHeader);
+    return std::string_view(name, strnlen(name, header->name_length));
+}
+
+/**
+ * Prints the statistics periodically
+ *
+ * @param router Router with the destinations
+ * @param interval Time between the prints
+ * @param count Returns the counters of the receiver and the transcoder
+ * @param running Cleared when the relay stops
+ */
+void printStats(Router &router, std::chrono::seconds interval, std::function<Counters()> count,
+                std::atomic<bool> &running)
+{
+    auto next = std::chrono::steady_clock::now() + interval;
+    while (running)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() < next)
+        {
+            continue;
+        }
+        next += interval;
+
+        Counters counters = count();
+        unsigned long forwarded = 0;
+        for (auto &destination : router.destinations)
+        {
+            forwarded += destination->forwarded_datagrams;
+            for (auto &stream : destination->getStreamStats())
+            {
+                forwarded += stream.second.frames;
+            }
+        }
+        std::cout << "received " << counters.received << ", forwarded " << forwarded << ", dropped by the kernel "
+                  << counters.kernel_drops;
+        if (counters.skipped)
+        {
+            std::cout << ", skipped by transcoding " << counters.skipped;
+        }
+        std::cout << std::endl;
+    }
+}
+
+/**
+ * Forwards reassembled frames
+ *
+ * @param config Relay configuration
+ * @param router Router with the destinations
+ */
+void relayFrames(Config &config, Router &router)
+{
+    farshow::FrameReceiver receiver(config.address, config.port);
+    if (config.io_uring)
+    {
+        receiver.setTransport(farshow::Transport::IO_URING);
+    }
+    farshow::FilterMode mode;
+    std::vector<std::string> names;
+    router.getFilter(mode, names);
+    receiver.setStreamFilter(mode, names);
+
+    std::unique_ptr<Transcoder> transcoder;
+    for (auto &destination : router.destinations)
+    {
+        if (destination->isTranscoded() && !transcoder)
+        {
+            transcoder = std::make_unique<Transcoder>(router, config.workers);
+        }
+    }
+
+    // The receiver never decodes frames, since nobody subscribes to decoded frames - the transcoder does it on its own
+    std::atomic<unsigned long> received = 0;
+    receiver.subscribeEncoded("",
+                              [&router, &received, &transcoder](const farshow::EncodedFrame &frame)
+                              {
+                                  received++;
+                                  for (Destination *destination : router.route(frame.name))
+                                  {
+                                      if (destination->isTranscoded())
+                                      {
+                                          continue;
+                                      }
+                                      // A failing destination doesn't stop relaying to the others
+                                      try
+                                      {
+                                          destination->sendEncodedFrame(frame.data, frame.size,
+                                                                        std::string(frame.name),
+                                                                        frame.timestamps.captured,
+                                                                        frame.timestamps.encoded);
+                                      }
+                                      catch (farshow::StreamException &e)
+                                      {
+                                          std::cerr << "\033[31m" << e.what() << "\033[0m" << std::endl;
+                                      }
+                                  }
+                                  if (transcoder)
+                                  {
+                                      transcoder->push(frame);
+                                  }
+                              });
+
+    std::atomic<bool> running = true;
+    std::thread stats;
+    if (config.stats_interval)
+    {
+        stats = std::thread(printStats, std::ref(router), std::chrono::seconds(config.stats_interval),
+                            [&]()
+                            {
+                                return Counters{received, receiver.getReassemblyStats().kernel_drops,
+                                                transcoder ? transcoder->skipped_frames.load() : 0};
+                            },
+                            std::ref(running));
+    }
+    auto stop_stats = [&running, &stats]()
+    {
+        running = false;
+        if (stats.joinable())
+        {
+            stats.join();
+        }
+    };
+    receiving_socket = receiver.getSocket();
+    try
+    {
+        receiver.run();
+    }
+    catch (...)
+    {
+        // A joinable thread would terminate the program before the error is printed
+        stop_stats();
+        throw;
+    }
+    stop_stats();
+}
+
+/**
+ * Forwards datagrams as they come
+ *
+ * @param config Relay configuration
+ * @param router Router with the destinations
+ */
+void relayDatagrams(Config &config, Router &router)
+{
+    DatagramReceiver receiver(config.address, config.port);
+    if (config.io_uring)
+    {
+        receiver.setTransport(farshow::Transport::IO_URING);
+    }
+
+    std::atomic<unsigned long> received = 0;
+    std::atomic<bool> running = true;
+    std::thread stats;
+    if (config.stats_interval)
+    {
+        stats = std::thread(printStats, std::ref(router), std::chrono::seconds(config.stats_interval),
+                            [&]() { return Counters{received, receiver.getKernelDrops(), 0}; },
+                            std::ref(running));
+    }
+    auto stop_stats = [&running, &stats]()
+    {
+        running = false;
+        if (stats.joinable())
+        {
+            stats.join();
+        }
+    };
+    receiving_socket = receiver.getSocket();
+
+    try
+    {
+        const char *data;
+        size_t size;
+        while ((size = receiver.receive(data)) > 0)
+        {
+            received++;
+            std::string_view name = getStreamName(data, size);
+            if (name.data() == nullptr)
+            {
+                continue;
+            }
+            for (Destination *destination : router.route(name))
+            {
+                try
+                {
+                    destination->forwardDatagram(data, size);
+                }
+                catch (farshow::StreamException &e)
+                {
+                    std::cerr << "\033[31m" << e.what() << "\033[0m" << std::endl;
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        // A joinable thread would terminate the program before the error is printed
+        stop_stats();
+        throw;
+    }
+    stop_stats();
+}
+
+//------------------ COMMAND LINE OPTIONS ----------------------
+
+/**
+ * Parses the route
+ *
+ * @param text Route in form `address:port[=stream,stream...][@scale[:quality]]`
+ *
+ * @returns Parsed route
+ */
+Route parseRoute(const std::string &text)
+{
+    Route route;
+    size_t at = text.rfind('@');
+    if (at != std::string::npos)
+    {
+        std::string rendition = text.substr(at + 1);
+        size_t colon = rendition.find(':');
+        route.scale = std::stod(rendition.substr(0, colon));
+        route.quality = colon == std::string::npos ? 70 : std::stoi(rendition.substr(colon + 1));
+        if (route.scale <= 0 || route.scale > 1 || route.quality < 1 || route.quality > 100)
+        {
+            throw std::invalid_argument("Invalid rendition of route '" + text + "'");
+        }
+    }
+    size_t equals = text.find('=');
+    std::string destination = text.substr(0, std::min(equals, at));
+    size_t colon = destination.rfind(':');
+    route.address = destination.substr(0, colon);
+    route.port = colon == std::string::npos ? 1100 : std::stoi(destination.substr(colon + 1));
+    struct in_addr parsed;
+    if (inet_aton(route.address.c_str(), &parsed) == 0)
+    {
+        throw std::invalid_argument("Invalid address of route '" + text + "'");
+    }
+
+    if (equals != std::string::npos)
+    {
+        std::string streams = text.substr(equals + 1, at == std::string::npos ? std::string::npos : at - equals - 1);
+        for (size_t start = 0; start <= streams.size();)
+        {
+            size_t comma = std::min(streams.find(',', start), streams.size());
+            if (comma > start)
+            {
+                route.streams.push_back(streams.substr(start, comma - start));
+            }
+            start = comma + 1;
+        }
+    }
+    return route;
+}
+
+/**
+ * Parses command line options
+ *
+ * @param argc Arguments counter
+ * @param argv Arguments values
+ *
+ * @returns Parsed configuration
+ */
+Config parseOptions(int argc, char const *argv[])
+{
+    Config config;
+    cxxopts::ParseResult result;
+
+    cxxopts::Options options("Farshow relay",
+                             "Receives streams and forwards them to other clients (also over broadcast or multicast), "
+                             "without decoding the frames, or as downscaled renditions.");
+
+    // clang-format off
+    options.add_options()
+        ("a, address", "Address to receive the streams on (all interfaces if not provided)",
+                cxxopts::value(config.address)->default_value(""))
+        ("p, port", "Port to receive the streams on", cxxopts::value(config.port)->default_value("1100"))
+        ("r, route", "Destination in form `address:port[=stream,stream...][@scale[:quality]]` - without the streams, "
+                "all streams are forwarded there, with the scale (and JPEG quality, 70 by default) the destination "
+                "gets transcoded renditions. Can be repeated.", cxxopts::value<std::vector<std::string>>())
+        ("x, exclude", "Stream, which isn't forwarded to the destinations of all streams. Can be repeated.",
+                cxxopts::value(config.exclude))
+        ("raw", "Forward datagrams as they come, without reassembling frames",
+                cxxopts::value(config.raw)->default_value("false"))
+        ("io-uring", "Receive and send with io_uring", cxxopts::value(config.io_uring)->default_value("false"))
+        ("ttl", "Time to live of multicast datagrams", cxxopts::value(config.ttl)->default_value("1"))
+        ("s, stats", "Print statistics every this many seconds (0 turns them off)",
+                cxxopts::value(config.stats_interval)->default_value("0"))
+        ("w, workers", "Number of threads transcoding the frames (the number of cores by default)",
+                cxxopts::value(config.workers)->default_value(std::to_string(std::thread::hardware_concurrency())))
+        ("h, help", "Print usage");
+    // clang-format on
+
+    try
+    {
+        result = options.parse(argc, argv);
+        if (result.count("route"))
+        {
+            for (auto &route : result["route"].as<std::vector<std::string>>())
+            {
+                config.routes.push_back(parseRoute(route));
+            }
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << std::endl
+                  << "\033[31mError while parsing command line arguments: " << e.what() << "\033[0m" << std::endl
+                  << std::endl;
+        std::cout << options.help() << std::endl;
+        exit(1);
+    }
+
+    if (result.count("help"))
+    {
+        std::cout << options.help() << std::endl;
+        exit(0);
+    }
+
+    if (config.routes.empty())
+    {
+        std::cerr << "\033[31mAt least one route is required\033[0m" << std::endl << std::endl;
+        std::cout << options.help() << std::endl;
+        exit(1);
+    }
+
+    for (auto &route : config.routes)
+    {
+        if (route.quality && config.raw)
+        {
+            std::cerr << "\033[31mRenditions can't be made in raw mode\033[0m" << std::endl;
+            exit(1);
+        }
+    }
+    config.workers = std::max(1u, config.workers);
+
+    return config;
+}
+
+void signalHandler(int signum)
+{
+    if (receiving_socket != -1)
+    {
+        shutdown(receiving_socket, SHUT_RDWR);
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    Config config = parseOptions(argc, argv);
+    signal(SIGINT, signalHandler); ///< exit with ^C
+
+    try
+    {
+        Router router(config);
+        if (config.raw)
+        {
+            relayDatagrams(config, router);
+        }
+        else
+        {
+            relayFrames(config, router);
+        }
+    }
+    catch (farshow::StreamException &e)
+    {
+        std::cerr << "\033[31m" << e.what() << "\033[0m" << std::endl;
+        return 1;
+    }
+}
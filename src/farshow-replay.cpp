@@ -0,0 +1,221 @@
+#include "farshow/framerecorder.hpp"
+#include "farshow/framesender.hpp"
+#include "farshow/streamexception.hpp"
+
+#include "cxxopts/cxxopts.hpp"
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+/**
+ * Sends a recorded session again, without re-encoding the frames.
+ *
+ * Frames are sent in the order and with the intervals in which they were received (reassembled) while recording,
+ * optionally sped up or slowed down, or as fast as possible.
+ */
+
+bool running; ///< if the replay should go on
+
+/**
+ * Configuration of current program execution
+ */
+typedef struct Config
+{
+    std::string client_ip;      ///< client's ip address
+    int client_port;            ///< client's port
+    std::string recording;      ///< directory with the recording
+    double speed;               ///< replay speed (0 means as fast as possible)
+    double start;               ///< seconds of the recording to skip
+    unsigned loops;             ///< number of replays (0 means forever)
+    unsigned frame_parts_delay; ///< sleep time in microseconds between sending frame parts
+    bool io_uring;              ///< if the io_uring transport should be used
+} Config;
+
+/**
+ * Summary of one replay
+ */
+typedef struct Summary
+{
+    unsigned long frames = 0;             ///< number of sent frames
+    unsigned long bytes = 0;              ///< size of sent frames
+    std::chrono::duration<double> time{}; ///< duration of the replay
+    std::chrono::duration<double> lag{};  ///< the longest delay of a frame after its scheduled time
+} Summary;
+
+/**
+ * Sends the frames of the recording, keeping the recorded intervals
+ *
+ * @param recording Recording to send
+ * @param sender Sender to use
+ * @param config Replay configuration
+ *
+ * @returns Summary of the replay
+ */
+Summary replay(farshow::FrameRecording &recording, farshow::FrameSender &sender, Config &config)
+{
+    Summary summary;
+    size_t first = recording.seekTime(recording.getFrame(0).timestamps.reassembled +
+                                      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                          std::chrono::duration<double>(config.start)));
+    if (first == recording.size())
+    {
+        return summary;
+    }
+
+    auto recorded_start = recording.getFrame(first).timestamps.reassembled;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = first; i < recording.size() && running; i++)
+    {
+        farshow::EncodedFrame frame = recording.getFrame(i);
+        if (config.speed > 0)
+        {
+            auto scheduled = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                         (frame.timestamps.reassembled - recorded_start) / config.speed);
+            // Sleep in short steps, to stop quickly on ^C during long gaps in the recording
+            while (running && std::chrono::steady_clock::now() < scheduled)
+            {
+                std::this_thread::sleep_until(
+                    std::min(scheduled, std::chrono::steady_clock::now() + std::chrono::milliseconds(100)));
+            }
+            if (!running)
+            {
+                break;
+            }
+            summary.lag = std::max<std::chrono::duration<double>>(summary.lag,
+                                                                  std::chrono::steady_clock::now() - scheduled);
+        }
+
+        // Keep the recorded encoding time, so the latency on the receiver counts from the replay
+        auto now = std::chrono::system_clock::now();
+        sender.sendEncodedFrame(frame.data, frame.size, std::string(frame.name),
+                                now - (frame.timestamps.encoded - frame.timestamps.captured), now);
+        summary.frames++;
+        summary.bytes += frame.size;
+    }
+    summary.time = std::chrono::steady_clock::now() - start;
+    return summary;
+}
+
+//------------------ COMMAND LINE OPTIONS ----------------------
+
+/**
+ * Parses command line options
+ *
+ * @param argc Arguments counter
+ * @param argv Arguments values
+ *
+ * @returns Parsed configuration
+ */
+Config parseOptions(int argc, char const *argv[])
+{
+    Config config;
+    cxxopts::ParseResult result;
+
+    cxxopts::Options options("Farshow replay", "Sends a session recorded with FrameRecorder again, without re-encoding "
+                                               "the frames.");
+
+    // clang-format off
+    options.add_options()
+        ("i, ip", "IP address of the client, which should receive the stream", cxxopts::value(config.client_ip))
+        ("p, port", "Port of the client, which will receive the stream",
+                cxxopts::value(config.client_port)->default_value("1100"))
+        ("r, recording", "Directory with the recording", cxxopts::value(config.recording))
+        ("s, speed", "Replay speed (e.g. 2 is twice as fast as recorded, 0 means as fast as possible)",
+                cxxopts::value(config.speed)->default_value("1"))
+        ("start", "Seconds of the recording to skip", cxxopts::value(config.start)->default_value("0"))
+        ("l, loops", "Number of replays (0 means forever)", cxxopts::value(config.loops)->default_value("1"))
+        ("d, delay", "Sleep time in microseconds between sending frame parts",
+                cxxopts::value(config.frame_parts_delay)->default_value("0"))
+        ("io-uring", "Send with io_uring", cxxopts::value(config.io_uring)->default_value("false"))
+        ("h, help", "Print usage");
+    // clang-format on
+
+    options.positional_help("<client ip address>");
+
+    try
+    {
+        options.parse_positional({"ip"});
+        result = options.parse(argc, argv);
+    }
+    catch (cxxopts::OptionException &e)
+    {
+        std::cerr << std::endl
+                  << "\033[31mError while parsing command line arguments: " << e.what() << "\033[0m" << std::endl
+                  << std::endl;
+        std::cout << options.help() << std::endl;
+        exit(1);
+    }
+
+    if (result.count("help"))
+    {
+        std::cout << options.help() << std::endl;
+        exit(0);
+    }
+
+    for (auto required : {"ip", "recording"})
+    {
+        if (result.count(required) == 0)
+        {
+            std::cerr << "\033[31mParameter '" << required << "' is required\033[0m" << std::endl << std::endl;
+            std::cout << options.help() << std::endl;
+            exit(1);
+        }
+    }
+
+    if (config.speed < 0)
+    {
+        std::cerr << "\033[31mSpeed can't be negative\033[0m" << std::endl;
+        exit(1);
+    }
+
+    return config;
+}
+
+void signalHandler(int signum) { running = false; }
+
+int main(int argc, const char **argv)
+{
+    running = true;
+    signal(SIGINT, signalHandler); ///< exit with ^C
+    Config config = parseOptions(argc, argv);
+
+    try
+    {
+        farshow::FrameRecording recording(config.recording);
+        if (recording.size() == 0)
+        {
+            std::cerr << "The recording is empty" << std::endl;
+            return 1;
+        }
+        std::cout << recording.size() << " frames of " << recording.getStreams().size() << " streams" << std::endl;
+
+        farshow::FrameSender sender(config.client_ip, config.client_port, config.frame_parts_delay);
+        if (config.io_uring && sender.setTransport(farshow::Transport::IO_URING) != farshow::Transport::IO_URING)
+        {
+            std::cerr << "io_uring is not available, sending with plain sockets" << std::endl;
+        }
+
+        for (unsigned loop = 0; running && (config.loops == 0 || loop < config.loops); loop++)
+        {
+            Summary summary = replay(recording, sender, config);
+            if (summary.frames == 0)
+            {
+                std::cerr << "No frames after " << config.start << " s of the recording" << std::endl;
+                return 1;
+            }
+            std::cout << "Sent " << summary.frames << " frames (" << summary.bytes / 1e6 << " MB) in "
+                      << summary.time.count() << " s, " << summary.frames / summary.time.count() << " fps";
+            if (config.speed > 0)
+            {
+                std::cout << ", lagging up to " << summary.lag.count() * 1000 << " ms";
+            }
+            std::cout << std::endl;
+        }
+    }
+    catch (farshow::StreamException &e)
+    {
+        std::cerr << "\033[31m" << e.what() << "\033[0m" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,87 @@
+#include "farshow/framemailbox.hpp"
+
+namespace farshow
+{
+
+FrameMailbox::FrameMailbox(DeliveryMode mode, size_t capacity)
+    : mode(mode), capacity(mode == DeliveryMode::LATEST || capacity == 0 ? 1 : capacity)
+{
+}
+
+void FrameMailbox::put(Frame frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed)
+        {
+            return;
+        }
+        while (frames.size() >= capacity)
+        {
+            frames.pop_front();
+            dropped++;
+        }
+        frames.push_back(std::move(frame));
+    }
+    available.notify_one();
+}
+
+bool FrameMailbox::tryTake(Frame &frame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (frames.empty())
+    {
+        return false;
+    }
+    frame = std::move(frames.front());
+    frames.pop_front();
+    return true;
+}
+
+bool FrameMailbox::take(Frame &frame)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this] { return !frames.empty() || closed; });
+    if (frames.empty())
+    {
+        return false;
+    }
+    frame = std::move(frames.front());
+    frames.pop_front();
+    return true;
+}
+
+bool FrameMailbox::take(Frame &frame, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!available.wait_for(lock, timeout, [this] { return !frames.empty() || closed; }) || frames.empty())
+    {
+        return false;
+    }
+    frame = std::move(frames.front());
+    frames.pop_front();
+    return true;
+}
+
+void FrameMailbox::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    available.notify_all();
+}
+
+bool FrameMailbox::isClosed()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return closed;
+}
+
+unsigned long FrameMailbox::getDropped()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped;
+}
+
+}; // namespace farshow
@@ -1,14 +1,36 @@
 #include "farshow/framereceiver.hpp"
+#include "farshow/framemailbox.hpp"
 #include "farshow/streamexception.hpp"
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <opencv2/imgcodecs.hpp>
 #include <unistd.h>
 
 namespace farshow
 {
 
-FrameReceiver::FrameReceiver(std::string client_address, int client_port) : UdpInterface(client_address, client_port)
+FrameReceiver::FrameReceiver(std::string client_address, int client_port, ReassemblyLimits limits, bool reuse_port)
+    : UdpInterface(client_address, client_port), limits(limits)
 {
+    int enable = 1;
+    if (reuse_port && setsockopt(mySocket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1)
+    {
+        close(mySocket);
+        throw StreamException("Cannot set SO_REUSEPORT", errno);
+    }
+    // Arrival times taken by the kernel don't include the time spent in the socket queue. Without them, the time of
+    // reading the datagram is used.
+    setsockopt(mySocket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+    // Count datagrams dropped because of the full receive buffer, to tell them apart from the network loss
+    setsockopt(mySocket, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+    int buffer_size;
+    socklen_t option_size = sizeof(buffer_size);
+    if (getsockopt(mySocket, SOL_SOCKET, SO_RCVBUF, &buffer_size, &option_size) == 0)
+    {
+        // The kernel reports the doubled requested size
+        receive_buffer = buffer_size;
+        requested_buffer = buffer_size / 2;
+    }
     if (bind(mySocket, (struct sockaddr *)&clientAddr, sizeof(clientAddr)) == -1)
     {
         close(mySocket);
@@ -16,40 +38,488 @@ FrameReceiver::FrameReceiver(std::string client_address, int client_port) : UdpI
     }
 }
 
-FrameMessage FrameReceiver::receiveFramePart()
+std::optional<size_t> FrameReceiver::receiveFramePart(std::chrono::steady_clock::time_point deadline)
 {
-    FrameMessage msg;
-
     // Wait for data
-    int res = recv(mySocket, &msg, sizeof(msg), 0);
-    if (res < 0)
+    const char *data;
+    std::optional<size_t> res = receiveDatagram(data, deadline);
+    if (!res)
     {
-        close(mySocket);
-        throw StreamException("Cannot receive message", errno);
+        return std::nullopt;
     }
-    else if (res == 0)
+    if (*res == 0)
     {
         // Parent thread has shut the socket down
         running = false;
         close(mySocket);
     }
+    message = (const FrameMessage *)data;
+
+    if (dropped_datagrams != kernel_drops)
+    {
+        // The buffer overflowed, even though it fits the recent frames
+        kernel_drops = dropped_datagrams;
+        growReceiveBuffer(requested_buffer * 2);
+    }
+
+    return res;
+}
+
+void FrameReceiver::growReceiveBuffer(size_t size)
+{
+    size = std::min(size, limits.max_receive_buffer);
+    if (size <= requested_buffer)
+    {
+        return;
+    }
+    requested_buffer = size;
+
+    int buffer_size = std::min<size_t>(size, INT_MAX);
+    // SO_RCVBUFFORCE can exceed net.core.rmem_max, but needs CAP_NET_ADMIN
+    if (setsockopt(mySocket, SOL_SOCKET, SO_RCVBUFFORCE, &buffer_size, sizeof(buffer_size)) == -1)
+    {
+        setsockopt(mySocket, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    }
+    socklen_t option_size = sizeof(buffer_size);
+    if (getsockopt(mySocket, SOL_SOCKET, SO_RCVBUF, &buffer_size, &option_size) == 0)
+    {
+        receive_buffer = buffer_size;
+    }
+}
+
+std::string_view FrameReceiver::getStreamName(const FrameMessage &msg)
+{
+    if (msg.header.name_length == 0 || msg.header.name_length > sizeof(msg.data))
+    {
+        return std::string_view();
+    }
+    // The name is sent with the terminating null character
+    return std::string_view(msg.data, strnlen(msg.data, msg.header.name_length));
+}
+
+bool FrameReceiver::isAccepted(std::string_view name)
+{
+    if (filter_version != used_filter.version)
+    {
+        // The filter changed since the receiving thread copied it
+        std::lock_guard<std::mutex> lock(filter_mutex);
+        used_filter = filter;
+        used_filter.version = filter_version;
+    }
+    if (!used_filter.enabled)
+    {
+        return true;
+    }
+    bool listed = used_filter.names.find(name) != used_filter.names.end();
+    return used_filter.mode == FilterMode::ALLOW ? listed : !listed;
+}
+
+void FrameReceiver::setStreamFilter(FilterMode mode, std::vector<std::string> names)
+{
+    std::lock_guard<std::mutex> lock(filter_mutex);
+    filter.enabled = true;
+    filter.mode = mode;
+    filter.names = StringSet(names.begin(), names.end());
+    filter_version++;
+}
+
+void FrameReceiver::clearStreamFilter()
+{
+    std::lock_guard<std::mutex> lock(filter_mutex);
+    filter.enabled = false;
+    filter.names.clear();
+    filter_version++;
+}
+
+std::optional<Frame> FrameReceiver::setStreamVisible(const std::string &name, bool visible)
+{
+    HeldFrame held;
+    {
+        std::lock_guard<std::mutex> lock(hidden_mutex);
+        if (!visible)
+        {
+            hidden_names.insert(name);
+            has_hidden = true;
+            return std::nullopt;
+        }
+        if (hidden_names.erase(name) == 0)
+        {
+            return std::nullopt;
+        }
+        has_hidden = !hidden_names.empty();
+        auto frame = held_frames.find(name);
+        if (frame == held_frames.end())
+        {
+            return std::nullopt;
+        }
+        held = std::move(frame->second);
+        held_frames.erase(frame);
+        total_bytes -= held.data.capacity();
+    }
+
+    // Decode the kept frame outside of the lock, so the receiving thread doesn't wait for it
+    return decodeHeld(name, held);
+}
+
+void FrameReceiver::setMaxDecodeRate(const std::string &name, float rate)
+{
+    std::lock_guard<std::mutex> lock(decode_rates_mutex);
+    decode_rates[name] = rate;
+    decode_rates_version++;
+}
+
+void FrameReceiver::copyFrame(const FrameContainer &frame, HeldFrame &held)
+{
+    total_bytes -= held.data.capacity();
+    held.data.assign(frame.img.begin(), frame.img.end());
+    total_bytes += held.data.capacity();
+    held.id = frame.id;
+    held.timestamps.captured = fromWireTime(frame.capture_time);
+    held.timestamps.encoded = fromWireTime(frame.encode_time);
+    held.timestamps.first_part = frame.first_part;
+    held.timestamps.last_part = frame.last_part;
+    held.timestamps.reassembled = std::chrono::system_clock::now();
+}
+
+void FrameReceiver::decodeFrame(const EncodedFrame &encoded, Frame &result)
+{
+    if (!decoder || !decoder(encoded, result))
+    {
+        result.img = cv::imdecode(cv::Mat(1, encoded.size, CV_8UC1, (void *)encoded.data), cv::IMREAD_UNCHANGED);
+    }
+    result.timestamps.decoded = std::chrono::system_clock::now();
+}
+
+Frame FrameReceiver::decodeHeld(const std::string &name, const HeldFrame &held)
+{
+    Frame result;
+    result.name = name;
+    result.timestamps = held.timestamps;
+    EncodedFrame encoded{result.name, held.id, held.data.data(), held.data.size(), result.timestamps};
+    decodeFrame(encoded, result);
+    return result;
+}
+
+bool FrameReceiver::isThrottled(Stream &stream, std::string_view name, std::chrono::steady_clock::time_point now)
+{
+    if (stream.rates_version != decode_rates_version)
+    {
+        // The limits changed since the stream looked them up
+        std::lock_guard<std::mutex> lock(decode_rates_mutex);
+        stream.rates_version = decode_rates_version;
+        auto rate = decode_rates.find(name);
+        if (rate == decode_rates.end())
+        {
+            rate = decode_rates.find(std::string_view());
+        }
+        stream.decode_interval = std::chrono::steady_clock::duration::zero();
+        if (rate != decode_rates.end() && rate->second > 0)
+        {
+            stream.decode_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / rate->second));
+        }
+    }
+    return now < stream.last_decode + stream.decode_interval;
+}
+
+std::optional<Frame> FrameReceiver::decodeDueFrame(std::chrono::steady_clock::time_point now)
+{
+    std::optional<Frame> result;
+    next_held_due = std::chrono::steady_clock::time_point::max();
+    for (auto &[name, stream] : streams)
+    {
+        if (!stream.held)
+        {
+            continue;
+        }
+        auto due = stream.last_decode + stream.decode_interval;
+        if (!result && now >= due)
+        {
+            auto start = std::chrono::system_clock::now();
+            result = decodeHeld(name, *stream.held);
+            stream.stats->decode_time.record(result->timestamps.decoded - start);
+            stream.stats->frameDelivered(std::chrono::steady_clock::now());
+            total_bytes -= stream.held->data.capacity();
+            stream.held.reset();
+            stream.last_decode = now;
+        }
+        else
+        {
+            // Other due frames are decoded with the next parts
+            next_held_due = std::min(next_held_due, due);
+        }
+    }
+    return result;
+}
+
+bool FrameReceiver::holdIfHidden(std::string_view name, const FrameContainer &frame)
+{
+    std::lock_guard<std::mutex> lock(hidden_mutex);
+    if (hidden_names.find(name) == hidden_names.end())
+    {
+        return false;
+    }
+    auto held = held_frames.find(name);
+    if (held == held_frames.end())
+    {
+        held = held_frames.emplace(name, HeldFrame()).first;
+    }
+    copyFrame(frame, held->second);
+    return true;
+}
+
+void FrameReceiver::eraseFrames(Stream &stream, std::list<FrameContainer>::iterator first,
+                                std::list<FrameContainer>::iterator last)
+{
+    for (auto itr = first; itr != last; itr++)
+    {
+        stream.bytes -= itr->img.capacity();
+        total_bytes -= itr->img.capacity();
+        if (!itr->isComplete())
+        {
+            dropped_frames++;
+            lost_parts += itr->total_parts - itr->added_parts;
+            stream.stats->dropped_frames++;
+            stream.stats->lost_parts += itr->total_parts - itr->added_parts;
+        }
+    }
+    stream.frames.erase(first, last);
+}
+
+void FrameReceiver::evictFrame(Stream &stream, std::list<FrameContainer>::iterator frame)
+{
+    evicted_frames++;
+    evicted_bytes += frame->img.capacity();
+    stream.stats->evicted_frames++;
+    eraseFrames(stream, frame, std::next(frame));
+}
+
+void FrameReceiver::evictHeld(Stream &stream)
+{
+    evicted_frames++;
+    evicted_bytes += stream.held->data.capacity();
+    stream.stats->evicted_frames++;
+    total_bytes -= stream.held->data.capacity();
+    stream.held.reset();
+}
+
+bool FrameReceiver::evictHiddenFrame()
+{
+    std::lock_guard<std::mutex> lock(hidden_mutex);
+    if (held_frames.empty())
+    {
+        return false;
+    }
+    auto frame = held_frames.begin();
+    evicted_frames++;
+    evicted_bytes += frame->second.data.capacity();
+    stream_stats.get(frame->first)->evicted_frames++;
+    total_bytes -= frame->second.data.capacity();
+    held_frames.erase(frame);
+    return true;
+}
+
+void FrameReceiver::evictStale(std::chrono::steady_clock::time_point now)
+{
+    for (auto stream = streams.begin(); stream != streams.end();)
+    {
+        auto &frames = stream->second.frames;
+        for (auto frame = frames.begin(); frame != frames.end();)
+        {
+            auto next = std::next(frame);
+            if (now - frame->last_update > limits.max_frame_age)
+            {
+                evictFrame(stream->second, frame);
+            }
+            frame = next;
+        }
+
+        // Forget streams, which stopped sending (after their kept frame is decoded)
+        if (frames.empty() && !stream->second.held && now - stream->second.last_update > limits.max_frame_age)
+        {
+            burst_bytes -= stream->second.frame_bytes;
+            stream = streams.erase(stream);
+            cached_stream = nullptr;
+        }
+        else
+        {
+            stream++;
+        }
+    }
+    last_sweep = now;
+}
+
+void FrameReceiver::enforceLimits(Stream &current_stream, std::list<FrameContainer>::iterator current_frame)
+{
+    // Per stream budget – evict the oldest frames of the stream
+    while (current_stream.bytes > limits.max_stream_bytes)
+    {
+        auto oldest = current_stream.frames.begin();
+        evictFrame(current_stream, oldest != current_frame ? oldest : std::next(oldest));
+    }
+
+    // Global budget – evict the kept frames of hidden streams, which are needed only when they are shown again, then
+    // the oldest frames of the least recently updated streams, and the frames kept by decode rate limits last
+    while (total_bytes > limits.max_total_bytes)
+    {
+        if (evictHiddenFrame())
+        {
+            continue;
+        }
+        Stream *lru = nullptr;
+        for (auto &stream : streams)
+        {
+            bool evictable = &stream.second == &current_stream ? stream.second.frames.size() > 1
+                                                               : !stream.second.frames.empty();
+            if (evictable && (lru == nullptr || stream.second.last_update < lru->last_update))
+            {
+                lru = &stream.second;
+            }
+        }
+        if (lru != nullptr)
+        {
+            auto oldest = lru->frames.begin();
+            evictFrame(*lru, oldest != current_frame ? oldest : std::next(oldest));
+            continue;
+        }
+        for (auto &stream : streams)
+        {
+            if (stream.second.held && (lru == nullptr || stream.second.last_update < lru->last_update))
+            {
+                lru = &stream.second;
+            }
+        }
+        evictHeld(*lru);
+    }
+}
+
+FrameReceiver::Stream &FrameReceiver::getStream(std::string_view name, std::chrono::steady_clock::time_point now)
+{
+    // Parts of a frame usually come one after another, so most of the time it's the same stream as before
+    if (cached_stream != nullptr && cached_name == name)
+    {
+        return *cached_stream;
+    }
+
+    auto stream = streams.find(name);
+    if (stream == streams.end())
+    {
+        // Make place for the new stream by forgetting the least recently updated one
+        if (!streams.empty() && streams.size() >= limits.max_streams)
+        {
+            auto lru = streams.begin();
+            for (auto itr = streams.begin(); itr != streams.end(); itr++)
+            {
+                if (itr->second.last_update < lru->second.last_update)
+                {
+                    lru = itr;
+                }
+            }
+            for (auto frame = lru->second.frames.begin(); frame != lru->second.frames.end();)
+            {
+                evictFrame(lru->second, frame++);
+            }
+            if (lru->second.held)
+            {
+                evictHeld(lru->second);
+            }
+            burst_bytes -= lru->second.frame_bytes;
+            streams.erase(lru);
+            cached_stream = nullptr;
+            evicted_streams++;
+        }
+        stream = streams
+                     .emplace(std::string(name), Stream{{}, 0, now, false, 0, 0, false, 0, stream_stats.get(name), 0,
+                                                        std::chrono::steady_clock::duration::zero(), 0, {}, {}})
+                     .first;
+    }
 
-    return msg;
+    // The key doesn't move until the stream is erased
+    cached_name = stream->first;
+    cached_stream = &stream->second;
+    return stream->second;
+}
+
+bool FrameReceiver::isValid(const FrameMessage &msg, size_t msg_size)
+{
+    // Reject parts, which don't belong to any frame or carry no data (an empty frame can't be decoded)
+    if (msg.header.part_id >= msg.header.total_parts || msg_size <= sizeof(msg.header) + msg.header.name_length)
+    {
+        invalid_parts++;
+        return false;
+    }
+
+    // Frames which can't fit the budget are dropped without allocating them
+    unsigned part_size = DATAGRAM_SIZE - sizeof(msg.header) - 3 - msg.header.name_length;
+    size_t frame_size = (size_t)msg.header.total_parts * part_size;
+    if (frame_size > limits.max_stream_bytes || frame_size > limits.max_total_bytes)
+    {
+        evicted_frames++;
+        return false;
+    }
+    return true;
+}
+
+void FrameReceiver::countMissingFrames(Stream &stream, unsigned id)
+{
+    // Ids wrap around, so up to a quarter of their range ahead is a later frame, anything else an earlier one
+    unsigned ahead = id - stream.last_started;
+    if (!stream.started_any)
+    {
+        stream.started_any = true;
+        stream.last_started = id;
+    }
+    else if (ahead != 0 && ahead <= UINT_MAX / 4)
+    {
+        stream.stats->missing_frames += ahead - 1;
+        stream.last_started = id;
+    }
+    else if (ahead != 0 && stream.stats->missing_frames > 0)
+    {
+        // A reordered frame, counted as missing when a later one started
+        stream.stats->missing_frames--;
+    }
 }
 
-std::list<FrameContainer>::iterator FrameReceiver::addPart(FrameMessage msg)
+std::optional<std::list<FrameContainer>::iterator> FrameReceiver::addPart(Stream &stream, const FrameMessage &msg,
+                                                                          size_t msg_size,
+                                                                          std::chrono::steady_clock::time_point now)
 {
     unsigned part_size = DATAGRAM_SIZE - sizeof(msg.header) - 3 - msg.header.name_length;
+    size_t payload_size = std::min<size_t>(part_size, msg_size - sizeof(msg.header) - msg.header.name_length);
+    size_t part_offset = (size_t)msg.header.part_id * part_size;
+    std::list<FrameContainer> &frames = stream.frames;
 
-    // Get stream name
-    std::string name = std::string(msg.data, msg.header.name_length);
+    // A restarted sender numbers the frames from 0 again. The numbering starts anew when the stream was quiet for
+    // longer than the frame age limit, or when a frame which isn't after the last completed one was captured later
+    // than it - but not so much later, that the capture time can't be trusted.
+    bool behind = stream.last_delivered - msg.header.frame_id <= UINT_MAX / 4;
+    uint64_t max_capture_gap = 2 * std::chrono::duration_cast<std::chrono::nanoseconds>(limits.max_frame_age).count();
+    if (stream.delivered_any &&
+        (now - stream.last_update > limits.max_frame_age ||
+         (behind && msg.header.capture_time > stream.last_captured &&
+          msg.header.capture_time - stream.last_captured <= max_capture_gap)))
+    {
+        stream.delivered_any = false;
+        stream.started_any = false;
+    }
+    stream.last_update = now;
+
+    // Late parts of already completed or older frames (e.g. duplicated or delayed datagrams) would start a frame which
+    // never completes
+    if (stream.delivered_any && behind)
+    {
+        duplicate_parts++;
+        stream.stats->duplicate_parts++;
+        return std::nullopt;
+    }
 
     // Find a frame
-    auto itr = streams[name].begin();
+    auto itr = frames.begin();
 
-    if (!streams[name].empty())
+    if (!frames.empty())
     {
-        while (itr != streams[name].end() && itr->id < msg.header.frame_id)
+        while (itr != frames.end() && itr->id < msg.header.frame_id)
         {
             itr++;
         }
@@ -60,10 +530,10 @@ std::list<FrameContainer>::iterator FrameReceiver::addPart(FrameMessage msg)
         // If there is, we add the frame in the end (after the frames with very large id's). Because we use UDP, frames'
         // parts can be late. I've set the size of the "gap" to UINT_MAX/4, to minimize the probability of misplacing
         // the frame, but this value can be changed later if we'll find a better one.
-        if (itr != streams[name].end() && itr->id - msg.header.frame_id > UINT_MAX / 4)
+        if (itr != frames.end() && itr->id - msg.header.frame_id > UINT_MAX / 4)
         {
             // Look for the proper place from the end
-            itr = streams[name].end();
+            itr = frames.end();
             while (std::prev(itr)->id < UINT_MAX * 3 / 4 && std::prev(itr)->id >= msg.header.frame_id)
             {
                 itr--;
@@ -71,49 +541,209 @@ std::list<FrameContainer>::iterator FrameReceiver::addPart(FrameMessage msg)
         }
     }
     // Delete old frame with same id and different size
-    if (itr != streams[name].end() && msg.header.total_parts != itr->total_parts)
+    if (itr != frames.end() && msg.header.total_parts != itr->total_parts)
+    {
+        eraseFrames(stream, itr, std::next(itr));
+        itr = frames.end();
+    }
+    if (itr == frames.end() || itr->id > msg.header.frame_id)
+    {
+        // Create a new frame. Single part frames take only as much memory as the received data.
+        size_t frame_size = msg.header.total_parts == 1 ? payload_size : (size_t)msg.header.total_parts * part_size;
+        itr = frames.emplace(itr, msg.header.frame_id, msg.header.total_parts, frame_size, part_size);
+        countMissingFrames(stream, msg.header.frame_id);
+        stream.bytes += itr->img.capacity();
+        total_bytes += itr->img.capacity();
+        enforceLimits(stream, itr);
+
+        // All parts of a frame are sent at once, and all streams may send a frame at the same moment. Keep room for
+        // two such bursts in the receive buffer.
+        burst_bytes += (size_t)msg.header.total_parts * msg_size - stream.frame_bytes;
+        stream.frame_bytes = (size_t)msg.header.total_parts * msg_size;
+        if (burst_bytes * 2 > requested_buffer)
+        {
+            growReceiveBuffer(burst_bytes * 2);
+        }
+    }
+    // Names differing only in padding after the null character map to the same stream, but give other part sizes –
+    // such a part would be copied to a wrong offset, possibly past the end of the frame
+    if (itr->part_size != part_size || part_offset + payload_size > itr->img.size())
+    {
+        invalid_parts++;
+        return std::nullopt;
+    }
+    // Skip parts, which were already received
+    if (!itr->markPart(msg.header.part_id))
     {
-        streams[name].erase(itr);
-        itr = streams[name].end();
+        duplicate_parts++;
+        stream.stats->duplicate_parts++;
+        return std::nullopt;
     }
-    if (itr == streams[name].end() || itr->id > msg.header.frame_id)
+    if (itr->added_parts == 1)
     {
-        // Create a new frame
-        unsigned frame_size = msg.header.total_parts * part_size;
-        FrameContainer frame = FrameContainer(msg.header.frame_id, msg.header.total_parts, name, frame_size);
-        itr = streams[name].insert(itr, frame);
+        itr->first_part = receive_time;
+        itr->capture_time = msg.header.capture_time;
+        itr->encode_time = msg.header.encode_time;
     }
+    itr->last_part = receive_time;
     // Copy image data to the frame pointed by iterator
-    memcpy(itr->img.data() + msg.header.part_id * part_size, msg.data + msg.header.name_length, part_size);
-    itr->added_parts++;
+    memcpy(itr->img.data() + part_offset, msg.data + msg.header.name_length, payload_size);
+    if (msg.header.part_id == msg.header.total_parts - 1)
+    {
+        // The last part tells the actual size of the frame
+        itr->img.resize(part_offset + payload_size);
+    }
+    itr->last_update = now;
 
     return itr;
 }
 
-cv::Mat FrameReceiver::prepareToShow(std::list<FrameContainer>::iterator frame)
+Frame FrameReceiver::prepareToShow(std::string_view name, Stream &stream, std::list<FrameContainer>::iterator frame,
+                                   bool decode)
 {
     // delete previous, uncomplete frames
-    streams[frame->name].erase(streams[frame->name].begin(), frame);
+    eraseFrames(stream, stream.frames.begin(), frame);
+
+    stream.delivered_any = true;
+    stream.last_delivered = frame->id;
+    stream.last_captured = frame->capture_time;
+
+    Frame result;
+    result.name = name;
+    result.timestamps.captured = fromWireTime(frame->capture_time);
+    result.timestamps.encoded = fromWireTime(frame->encode_time);
+    result.timestamps.first_part = frame->first_part;
+    result.timestamps.last_part = frame->last_part;
+    result.timestamps.reassembled = std::chrono::system_clock::now();
 
-    // decode the frame
-    return cv::imdecode((*frame).img, cv::IMREAD_UNCHANGED);
+    EncodedFrame encoded{result.name, frame->id, frame->img.data(), frame->img.size(), result.timestamps};
+    if (has_encoded_subscribers)
+    {
+        deliverEncoded(encoded);
+    }
+
+    stream.stats->reassembly_time.record(result.timestamps.reassembled - result.timestamps.first_part);
+    if (decode)
+    {
+        // decode the frame and release its buffer
+        decodeFrame(encoded, result);
+        stream.stats->decode_time.record(result.timestamps.decoded - result.timestamps.reassembled);
+        stream.stats->frameDelivered(std::chrono::steady_clock::now());
+    }
+    stream.stats->complete_frames++;
+    eraseFrames(stream, frame, std::next(frame));
+    return result;
+}
+
+void FrameReceiver::setReassemblyLimits(ReassemblyLimits new_limits) { limits = new_limits; }
+
+ReassemblyStats FrameReceiver::getReassemblyStats()
+{
+    return ReassemblyStats{evicted_frames, evicted_bytes,  evicted_streams, total_bytes,
+                           duplicate_parts, invalid_parts, dropped_frames, lost_parts,
+                           kernel_drops,   receive_buffer};
 }
 
-Frame FrameReceiver::receiveFrame()
+Frame FrameReceiver::receiveFrame() { return receiveCompleteFrame(true); }
+
+bool FrameReceiver::hasFrameSubscribers(std::string_view name)
 {
-    FrameMessage frame_part;
-    std::list<FrameContainer>::iterator frame;
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    auto stream = subscribers.find(name);
+    auto all = subscribers.find(std::string_view());
+    return (stream != subscribers.end() && !stream->second.empty()) ||
+           (all != subscribers.end() && !all->second.empty());
+}
 
+Frame FrameReceiver::receiveCompleteFrame(bool decode_all)
+{
     while (1)
     {
-        FrameMessage frame_part = receiveFramePart();
+        // Kept frames are checked between the parts, so a part isn't dropped for them, and the wait for the next
+        // part ends when the earliest of them is due
+        if (next_held_due != std::chrono::steady_clock::time_point::max())
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_held_due)
+            {
+                std::optional<Frame> due = decodeDueFrame(now);
+                if (due)
+                {
+                    return std::move(*due);
+                }
+            }
+        }
+
+        std::optional<size_t> received = receiveFramePart(next_held_due);
+        if (!received)
+        {
+            continue;
+        }
+        size_t size = *received;
         if (running)
         {
-            frame = addPart(frame_part);
+            // Drop malformed packets, packets of other header versions and packets of unwanted streams before doing
+            // anything with them
+            if (size < sizeof(FrameHeader) || message->header.magic != FRAME_MAGIC ||
+                message->header.version != FRAME_VERSION)
+            {
+                invalid_parts++;
+                continue;
+            }
+            std::string_view name = getStreamName(*message);
+            if (name.data() == nullptr || !isAccepted(name) || !isValid(*message, size))
+            {
+                continue;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_sweep > limits.max_frame_age / 4)
+            {
+                evictStale(now);
+            }
+
+            Stream &stream = getStream(name, now);
+            stream.stats->packets++;
+            stream.stats->bytes += size;
+            std::optional<std::list<FrameContainer>::iterator> frame = addPart(stream, *message, size, now);
 
-            if ((*frame).isComplete())
+            if (frame && (*frame)->isComplete())
             {
-                return Frame{frame->name, prepareToShow(frame)};
+                // Frames of hidden streams are only kept encoded, in place of the previous one
+                if (has_hidden && holdIfHidden(name, **frame))
+                {
+                    prepareToShow(name, stream, *frame, false);
+                    continue;
+                }
+                bool decode = decode_all || hasFrameSubscribers(name);
+                if (decode && isThrottled(stream, name, now))
+                {
+                    // Keep only the newest frame until the decode rate limit allows decoding it
+                    if (stream.held)
+                    {
+                        stream.stats->skipped_frames++;
+                    }
+                    else
+                    {
+                        stream.held.emplace();
+                    }
+                    copyFrame(**frame, *stream.held);
+                    next_held_due = std::min(next_held_due, stream.last_decode + stream.decode_interval);
+                    prepareToShow(name, stream, *frame, false);
+                    continue;
+                }
+                if (stream.held)
+                {
+                    // The newer frame replaces the kept one
+                    stream.stats->skipped_frames++;
+                    total_bytes -= stream.held->data.capacity();
+                    stream.held.reset();
+                }
+                if (decode)
+                {
+                    stream.last_decode = now;
+                }
+                return prepareToShow(name, stream, *frame, decode);
             }
         }
         else
@@ -123,4 +753,133 @@ Frame FrameReceiver::receiveFrame()
     }
 }
 
+void FrameReceiver::subscribe(std::string name, FrameCallback callback)
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    subscribers[name].push_back(Subscriber{callback, nullptr});
+}
+
+std::shared_ptr<FrameMailbox> FrameReceiver::subscribe(std::string name, DeliveryMode mode, size_t capacity)
+{
+    auto mailbox = std::make_shared<FrameMailbox>(mode, capacity);
+    subscribe(name, mailbox);
+    return mailbox;
+}
+
+void FrameReceiver::subscribe(std::string name, std::shared_ptr<FrameMailbox> mailbox)
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    subscribers[name].push_back(Subscriber{nullptr, mailbox});
+}
+
+void FrameReceiver::subscribeEncoded(std::string name, EncodedFrameCallback callback)
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    encoded_subscribers[name].push_back(callback);
+    has_encoded_subscribers = true;
+}
+
+void FrameReceiver::unsubscribe(std::string name, std::shared_ptr<FrameMailbox> kept)
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    encoded_subscribers.erase(name);
+    has_encoded_subscribers = !encoded_subscribers.empty();
+    auto stream = subscribers.find(name);
+    if (stream == subscribers.end())
+    {
+        return;
+    }
+    for (auto &subscriber : stream->second)
+    {
+        if (subscriber.mailbox && subscriber.mailbox != kept)
+        {
+            subscriber.mailbox->close();
+        }
+    }
+    if (kept && std::any_of(stream->second.begin(), stream->second.end(),
+                            [&kept](const Subscriber &subscriber) { return subscriber.mailbox == kept; }))
+    {
+        stream->second = {Subscriber{nullptr, kept}};
+        return;
+    }
+    subscribers.erase(stream);
+}
+
+void FrameReceiver::deliver(Frame &frame)
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    for (const std::string &name : {frame.name, std::string()})
+    {
+        auto stream = subscribers.find(name);
+        if (stream == subscribers.end())
+        {
+            if (frame.name.empty())
+            {
+                break;
+            }
+            continue;
+        }
+        for (auto &subscriber : stream->second)
+        {
+            if (subscriber.mailbox)
+            {
+                subscriber.mailbox->put(frame);
+            }
+            else
+            {
+                subscriber.callback(frame);
+            }
+        }
+        if (frame.name.empty())
+        {
+            // Subscribers of all streams were already served
+            break;
+        }
+    }
+}
+
+void FrameReceiver::deliverEncoded(const EncodedFrame &frame)
+{
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    for (std::string_view name : {frame.name, std::string_view()})
+    {
+        auto stream = encoded_subscribers.find(name);
+        if (stream != encoded_subscribers.end())
+        {
+            for (auto &callback : stream->second)
+            {
+                callback(frame);
+            }
+        }
+        if (frame.name.empty())
+        {
+            // Subscribers of all streams were already served
+            break;
+        }
+    }
+}
+
+void FrameReceiver::run()
+{
+    Frame frame = receiveCompleteFrame(false);
+    while (running)
+    {
+        deliver(frame);
+        frame = receiveCompleteFrame(false);
+    }
+
+    // Wake up consumers waiting for frames
+    std::lock_guard<std::mutex> lock(subscribers_mutex);
+    for (auto &stream : subscribers)
+    {
+        for (auto &subscriber : stream.second)
+        {
+            if (subscriber.mailbox)
+            {
+                subscriber.mailbox->close();
+            }
+        }
+    }
+}
+
 }; // namespace farshow
@@ -0,0 +1,654 @@
+#include "farshow/framerecorder.hpp"
+#include "farshow/streamexception.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace farshow
+{
+
+/**
+ * Builds the path of a segment file
+ *
+ * @param directory Directory with the segment files
+ * @param segment Number of the segment
+ * @param extension `.frames` or `.index`
+ *
+ * @returns Path of the file
+ */
+static std::string segmentPath(const std::string &directory, unsigned segment, const char *extension)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%06u%s", segment, extension);
+    return directory + name;
+}
+
+/**
+ * Writes the whole data, retrying after partial writes
+ *
+ * @param fd File descriptor
+ * @param data Data to write
+ * @param size Size of the data
+ * @param offset Offset in the file
+ */
+static void writeAll(int fd, const char *data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t res = pwrite(fd, data, size, offset);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw StreamException("Cannot write the recording", errno);
+        }
+        data += res;
+        size -= res;
+        offset += res;
+    }
+}
+
+/**
+ * Rounds the size up to RECORDING_ALIGNMENT
+ *
+ * @param size Size to round
+ *
+ * @returns Rounded size
+ */
+static size_t alignUp(size_t size)
+{
+    return (size + RECORDING_ALIGNMENT - 1) / RECORDING_ALIGNMENT * RECORDING_ALIGNMENT;
+}
+
+//------------------------- RECORDER ---------------------------
+
+FrameRecorder::FrameRecorder(std::string directory, size_t segment_size, bool direct_io, size_t buffer_size)
+    : directory(directory), segment_size(segment_size), direct_io(direct_io),
+      buffer_size(alignUp(std::max<size_t>(buffer_size, RECORDING_ALIGNMENT)))
+{
+    if (mkdir(directory.c_str(), 0755) == -1 && errno != EEXIST)
+    {
+        throw StreamException("Cannot create the recording directory", errno);
+    }
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr)
+    {
+        throw StreamException("Cannot open the recording directory", errno);
+    }
+    // Stream ids are numbered per recording, so recordings can't be mixed in one directory
+    bool empty = true;
+    while (dirent *entry = readdir(dir))
+    {
+        empty = empty && (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0);
+    }
+    closedir(dir);
+    if (!empty)
+    {
+        throw StreamException("Recording directory " + directory + " isn't empty");
+    }
+
+    try
+    {
+        for (int i = 0; i < RECORDING_BUFFERS; i++)
+        {
+            char *allocated = (char *)aligned_alloc(RECORDING_ALIGNMENT, this->buffer_size);
+            if (allocated == nullptr)
+            {
+                throw StreamException("Cannot allocate the write buffer", ENOMEM);
+            }
+            buffers.push_back(allocated);
+        }
+        std::string streams_path = directory + "/streams";
+        streams_fd = open(streams_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (streams_fd == -1)
+        {
+            throw StreamException("Cannot create " + streams_path, errno);
+        }
+        startSegment();
+    }
+    catch (StreamException &)
+    {
+        if (streams_fd != -1)
+        {
+            ::close(streams_fd);
+        }
+        for (char *allocated : buffers)
+        {
+            free(allocated);
+        }
+        throw;
+    }
+    buffer = buffers[0];
+    free_buffers.assign(buffers.begin() + 1, buffers.end());
+    writer = std::thread(&FrameRecorder::writeLoop, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    try
+    {
+        close();
+    }
+    catch (StreamException &e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+    for (char *allocated : buffers)
+    {
+        free(allocated);
+    }
+}
+
+void FrameRecorder::startSegment()
+{
+    std::string data_path = segmentPath(directory, segment, ".frames");
+    if (direct_io)
+    {
+        data_fd = open(data_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (data_fd == -1 && errno == EINVAL)
+        {
+            // The file system doesn't support O_DIRECT
+            direct_io = false;
+        }
+    }
+    if (!direct_io)
+    {
+        data_fd = open(data_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (data_fd == -1)
+    {
+        throw StreamException("Cannot create " + data_path, errno);
+    }
+    std::string index_path = segmentPath(directory, segment, ".index");
+    index_fd = open(index_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (index_fd == -1)
+    {
+        int error = errno;
+        ::close(data_fd);
+        throw StreamException("Cannot create " + index_path, error);
+    }
+    used = 0;
+    buffer_offset = 0;
+}
+
+void FrameRecorder::finishSegment()
+{
+    submitBuffer();
+    {
+        // The last block was written padded
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        jobs.push_back(WriteJob{nullptr, 0, buffer_offset + used, data_fd, index_fd, {}});
+    }
+    queued.notify_one();
+    data_fd = index_fd = -1;
+    segment++;
+}
+
+void FrameRecorder::submitBuffer()
+{
+    WriteJob job{buffer, 0, buffer_offset, data_fd, index_fd, {}};
+    if (used > 0)
+    {
+        // The partial block at the end is padded with zeros
+        memset(buffer + used, 0, alignUp(used) - used);
+        job.size = alignUp(used);
+    }
+
+    // Index the records, which will be in the file
+    uint64_t end = buffer_offset + used;
+    size_t complete = 0;
+    while (complete < pending_entries.size() && pending_entries[complete].second <= end)
+    {
+        job.entries.push_back(pending_entries[complete].first);
+        complete++;
+    }
+    pending_entries.erase(pending_entries.begin(), pending_entries.begin() + complete);
+    if (job.size == 0 && job.entries.empty())
+    {
+        return;
+    }
+
+    char *next;
+    {
+        std::unique_lock<std::mutex> lock(writer_mutex);
+        written.wait(lock, [this]() { return !free_buffers.empty(); });
+        next = free_buffers.back();
+        free_buffers.pop_back();
+        jobs.push_back(std::move(job));
+    }
+    queued.notify_one();
+
+    // Keep the partial block, it will be written again with the following data
+    size_t full = used / RECORDING_ALIGNMENT * RECORDING_ALIGNMENT;
+    memcpy(next, buffer + full, used - full);
+    buffer = next;
+    buffer_offset += full;
+    used -= full;
+}
+
+void FrameRecorder::writeLoop()
+{
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    while (true)
+    {
+        queued.wait(lock, [this]() { return !jobs.empty() || stopping; });
+        if (jobs.empty())
+        {
+            return;
+        }
+        WriteJob job = std::move(jobs.front());
+        jobs.pop_front();
+        writing = true;
+        lock.unlock();
+
+        std::optional<StreamException> failure;
+        try
+        {
+            writeJob(job);
+        }
+        catch (StreamException &e)
+        {
+            failure = e;
+        }
+
+        lock.lock();
+        if (job.buffer)
+        {
+            free_buffers.push_back(job.buffer);
+        }
+        if (failure && !error)
+        {
+            error = failure;
+        }
+        writing = false;
+        written.notify_all();
+    }
+}
+
+void FrameRecorder::writeJob(const WriteJob &job)
+{
+    if (job.buffer == nullptr)
+    {
+        // Finish the segment, closing the files even if truncating fails
+        int res = ftruncate(job.data_fd, job.offset);
+        int truncate_error = errno;
+        ::close(job.data_fd);
+        ::close(job.index_fd);
+        if (res == -1)
+        {
+            throw StreamException("Cannot truncate the recording", truncate_error);
+        }
+        return;
+    }
+
+    writeAll(job.data_fd, job.buffer, job.size, job.offset);
+
+    const char *data = (const char *)job.entries.data();
+    size_t size = job.entries.size() * sizeof(RecordIndexEntry);
+    while (size > 0)
+    {
+        ssize_t res = ::write(job.index_fd, data, size);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw StreamException("Cannot write the recording index", errno);
+        }
+        data += res;
+        size -= res;
+    }
+}
+
+void FrameRecorder::waitForWriter()
+{
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    written.wait(lock, [this]() { return jobs.empty() && !writing; });
+}
+
+void FrameRecorder::throwWriteError()
+{
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    if (error)
+    {
+        StreamException failure = *error;
+        error.reset();
+        throw failure;
+    }
+}
+
+void FrameRecorder::append(const void *data, size_t size)
+{
+    const char *bytes = (const char *)data;
+    while (size > 0)
+    {
+        size_t chunk = std::min(size, buffer_size - used);
+        memcpy(buffer + used, bytes, chunk);
+        used += chunk;
+        bytes += chunk;
+        size -= chunk;
+        if (used == buffer_size)
+        {
+            submitBuffer();
+        }
+    }
+}
+
+void FrameRecorder::record(const EncodedFrame &frame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed)
+    {
+        return;
+    }
+
+    static const char padding[8] = {};
+    size_t record_size = sizeof(RecordHeader) + frame.name.size() + frame.size;
+    size_t padding_size = (8 - record_size % 8) % 8;
+    record_size += padding_size;
+
+    uint64_t offset = buffer_offset + used;
+    if (offset > 0 && offset + record_size > segment_size)
+    {
+        finishSegment();
+        startSegment();
+        offset = 0;
+    }
+
+    auto stream = stream_ids.find(frame.name);
+    if (stream == stream_ids.end())
+    {
+        // The names are written before any index entry refers to them
+        std::string name(frame.name);
+        writeAll(streams_fd, name.c_str(), name.size() + 1, streams_size);
+        streams_size += name.size() + 1;
+        stream = stream_ids.emplace(name, stream_ids.size()).first;
+    }
+
+    RecordHeader header{};
+    header.magic = RECORD_MAGIC;
+    header.name_length = frame.name.size();
+    header.size = frame.size;
+    header.frame_id = frame.id;
+    header.stream_id = stream->second;
+    header.captured = toWireTime(frame.timestamps.captured);
+    header.encoded = toWireTime(frame.timestamps.encoded);
+    header.first_part = toWireTime(frame.timestamps.first_part);
+    header.last_part = toWireTime(frame.timestamps.last_part);
+    header.reassembled = toWireTime(frame.timestamps.reassembled);
+
+    pending_entries.emplace_back(RecordIndexEntry{header.reassembled, offset, header.frame_id, header.stream_id},
+                                 offset + record_size);
+    append(&header, sizeof(header));
+    append(frame.name.data(), frame.name.size());
+    append(frame.data, frame.size);
+    append(padding, padding_size);
+    frames++;
+    throwWriteError();
+}
+
+void FrameRecorder::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!closed)
+    {
+        submitBuffer();
+        waitForWriter();
+    }
+    throwWriteError();
+}
+
+void FrameRecorder::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!closed)
+    {
+        closed = true;
+        finishSegment();
+        {
+            std::lock_guard<std::mutex> writer_lock(writer_mutex);
+            stopping = true;
+        }
+        queued.notify_one();
+        writer.join();
+        ::close(streams_fd);
+    }
+    throwWriteError();
+}
+
+unsigned long FrameRecorder::getRecordedFrames()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames;
+}
+
+//------------------------- RECORDING --------------------------
+
+/**
+ * Maps the whole file for reading
+ *
+ * @param path Path of the file
+ * @param size Set to the size of the file
+ * @param advice Expected access pattern (for madvise)
+ *
+ * @returns Mapped file, nullptr if the file is empty
+ */
+static const char *mapFile(const std::string &path, size_t &size, int advice)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        throw StreamException("Cannot open " + path, errno);
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1)
+    {
+        int error = errno;
+        close(fd);
+        throw StreamException("Cannot read the size of " + path, error);
+    }
+    size = info.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file open
+    if (data == MAP_FAILED)
+    {
+        throw StreamException("Cannot map " + path, errno);
+    }
+    madvise(data, size, advice);
+    return (const char *)data;
+}
+
+FrameRecording::FrameRecording(std::string directory)
+{
+    try
+    {
+        std::string streams_path = directory + "/streams";
+        if (access(streams_path.c_str(), F_OK) == -1)
+        {
+            throw StreamException("No recording in " + directory);
+        }
+        size_t names_size;
+        const char *names = mapFile(streams_path, names_size, MADV_SEQUENTIAL);
+        // Null-terminated names, in the order of the stream ids
+        for (size_t start = 0; start < names_size;)
+        {
+            size_t length = strnlen(names + start, names_size - start);
+            stream_names.emplace_back(names + start, length);
+            start += length + 1;
+        }
+        if (names)
+        {
+            munmap((void *)names, names_size);
+        }
+
+        for (unsigned segment = 0;; segment++)
+        {
+            std::string index_path = segmentPath(directory, segment, ".index");
+            if (access(index_path.c_str(), F_OK) == -1)
+            {
+                break;
+            }
+            Segment mapped{};
+            mapped.data = mapFile(segmentPath(directory, segment, ".frames"), mapped.data_size, MADV_RANDOM);
+            segments.push_back(mapped);
+            Segment &current = segments.back();
+            current.index = (const RecordIndexEntry *)mapFile(index_path, current.index_size, MADV_SEQUENTIAL);
+            current.first = total_frames;
+
+            // Only the index is read - entries of records, which weren't written completely (e.g. when the recorder
+            // was killed), are skipped, records themselves are checked when they're read
+            size_t entries = current.index_size / sizeof(RecordIndexEntry);
+            for (size_t i = 0; i < entries; i++)
+            {
+                const RecordIndexEntry &entry = current.index[i];
+                if (entry.offset + sizeof(RecordHeader) > current.data_size || entry.stream_id >= stream_names.size())
+                {
+                    break;
+                }
+                current.last_time = std::max(current.last_time, entry.time);
+                current.frames++;
+                total_frames++;
+            }
+        }
+    }
+    catch (StreamException &)
+    {
+        unmap();
+        throw;
+    }
+    if (segments.empty())
+    {
+        throw StreamException("No recording in " + directory);
+    }
+}
+
+FrameRecording::~FrameRecording() { unmap(); }
+
+void FrameRecording::unmap()
+{
+    for (auto &segment : segments)
+    {
+        if (segment.data)
+        {
+            munmap((void *)segment.data, segment.data_size);
+        }
+        if (segment.index)
+        {
+            munmap((void *)segment.index, segment.index_size);
+        }
+    }
+    segments.clear();
+}
+
+std::pair<const FrameRecording::Segment *, const RecordIndexEntry *> FrameRecording::locate(size_t index)
+{
+    if (index >= total_frames)
+    {
+        throw StreamException("Frame " + std::to_string(index) + " is out of the recording");
+    }
+    // The last segment, which starts at the frame or before it
+    auto segment = std::upper_bound(segments.begin(), segments.end(), index,
+                                    [](size_t index, const Segment &segment) { return index < segment.first; });
+    segment--;
+    return {&*segment, &segment->index[index - segment->first]};
+}
+
+EncodedFrame FrameRecording::getFrame(size_t index)
+{
+    auto [segment, entry] = locate(index);
+    const RecordHeader *header = (const RecordHeader *)(segment->data + entry->offset);
+    if (header->magic != RECORD_MAGIC ||
+        entry->offset + sizeof(RecordHeader) + header->name_length + header->size > segment->data_size)
+    {
+        throw StreamException("Frame " + std::to_string(index) + " of the recording is damaged");
+    }
+    const char *name = (const char *)(header + 1);
+
+    EncodedFrame frame;
+    frame.name = std::string_view(name, header->name_length);
+    frame.id = header->frame_id;
+    frame.data = (const uchar *)(name + header->name_length);
+    frame.size = header->size;
+    frame.timestamps.captured = fromWireTime(header->captured);
+    frame.timestamps.encoded = fromWireTime(header->encoded);
+    frame.timestamps.first_part = fromWireTime(header->first_part);
+    frame.timestamps.last_part = fromWireTime(header->last_part);
+    frame.timestamps.reassembled = fromWireTime(header->reassembled);
+    return frame;
+}
+
+size_t FrameRecording::seekTime(std::chrono::system_clock::time_point time)
+{
+    uint64_t wire_time = toWireTime(time);
+
+    // Frames recorded from several threads interleave, so the times aren't sorted. Segments without later frames are
+    // skipped, the others are searched in the order of recording.
+    for (const Segment &segment : segments)
+    {
+        if (segment.frames == 0 || segment.last_time < wire_time)
+        {
+            continue;
+        }
+        for (size_t i = 0; i < segment.frames; i++)
+        {
+            if (segment.index[i].time >= wire_time)
+            {
+                return segment.first + i;
+            }
+        }
+    }
+    return total_frames;
+}
+
+std::optional<size_t> FrameRecording::seekFrame(std::string_view name, unsigned frame_id)
+{
+    auto stream = std::find(stream_names.begin(), stream_names.end(), name);
+    if (stream == stream_names.end())
+    {
+        return std::nullopt;
+    }
+    // Ids wrap around and start from 0 again when the sender restarts, so they are searched in the order of recording
+    uint32_t stream_id = stream - stream_names.begin();
+    for (const Segment &segment : segments)
+    {
+        for (size_t i = 0; i < segment.frames; i++)
+        {
+            if (segment.index[i].stream_id == stream_id && segment.index[i].frame_id == frame_id)
+            {
+                return segment.first + i;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string> FrameRecording::getStreams()
+{
+    std::vector<std::string> result;
+    for (auto &name : stream_names)
+    {
+        if (!name.empty())
+        {
+            result.push_back(name);
+        }
+    }
+    return result;
+}
+
+}; // namespace farshow
@@ -7,50 +7,87 @@
 namespace farshow
 {
 
-void FrameSender::sendFrame(cv::Mat &frame, std::string name, std::string extension, std::vector<int> encoding_params)
+void FrameSender::sendFrame(cv::Mat &frame, std::string name, std::string extension, std::vector<int> encoding_params,
+                            std::chrono::system_clock::time_point capture_time)
 {
+    if (capture_time.time_since_epoch().count() == 0)
+    {
+        capture_time = std::chrono::system_clock::now();
+    }
+
+    // Compress the image
+    auto encode_start = std::chrono::steady_clock::now();
+    std::vector<uchar> compressed_frame;
+    cv::imencode(extension, frame, compressed_frame, encoding_params);
+    getStats(name).encode_time.record(std::chrono::steady_clock::now() - encode_start);
+
+    sendEncodedFrame(compressed_frame.data(), compressed_frame.size(), name, capture_time,
+                     std::chrono::system_clock::now());
+}
+
+void FrameSender::sendEncodedFrame(const uchar *data, size_t size, std::string name,
+                                   std::chrono::system_clock::time_point capture_time,
+                                   std::chrono::system_clock::time_point encode_time)
+{
+    auto now = std::chrono::system_clock::now();
+    auto send_start = std::chrono::steady_clock::now();
+    SenderStreamStats &stats = getStats(name);
+
     // Create a message
     FrameMessage msg{};
 
     strncpy(msg.data, name.c_str(), sizeof(msg.data) / sizeof(msg.data[0]));
     msg.header.name_length = name.length() + 1;
-    msg.header.frame_id = curr_frame_id++;
+    msg.header.frame_id = next_frame_ids[name]++;
     msg.header.part_id = 0;
+    msg.header.capture_time = toWireTime(capture_time.time_since_epoch().count() ? capture_time : now);
+    msg.header.encode_time = toWireTime(encode_time.time_since_epoch().count() ? encode_time : now);
 
-    // Compress the image
-    std::vector<uchar> compressed_frame;
     unsigned available_space = DATAGRAM_SIZE - msg.header.name_length - sizeof(msg.header) - 3;
 
-    cv::imencode(extension, frame, compressed_frame, encoding_params);
+    // Split frame to parts
+    msg.header.total_parts = std::max<size_t>(1, (size + available_space - 1) / available_space);
 
-    if (compressed_frame.size() <= available_space)
+    // Send parts
+    try
     {
-        // Will fit one message
-        msg.header.total_parts = 1;
+        for (size_t offset = 0; msg.header.part_id < msg.header.total_parts; offset += available_space)
+        {
+            unsigned data_size = std::min<size_t>(size - offset, available_space);
+            memcpy(msg.data + msg.header.name_length, data + offset, data_size);
+
+            // Send only the used part of the message
+            sendDatagram(&msg, sizeof(msg.header) + msg.header.name_length + data_size);
+            msg.header.part_id++;
+
+            if (frame_parts_delay)
+            {
+                flushDatagrams();
+                usleep(frame_parts_delay);
+            }
+        }
+        flushDatagrams();
     }
-    else
+    catch (StreamException &)
     {
-        // Split frame to parts
-        msg.header.total_parts = std::ceil((float)compressed_frame.size() / available_space);
+        stats.drops++;
+        throw;
     }
 
-    // Send parts
-    uchar *position = compressed_frame.data(); // Data not send yet
-
-    unsigned data_size = std::min<unsigned>(compressed_frame.size(), available_space);
+    stats.frames++;
+    stats.bytes += size;
+    stats.parts += msg.header.total_parts;
+    stats.send_time.record(std::chrono::steady_clock::now() - send_start);
+}
 
-    while (position <= compressed_frame.data() + compressed_frame.size())
+SenderStreamStats &FrameSender::getStats(const std::string &name)
+{
+    std::shared_ptr<SenderStreamStats> &stats = local_stats[name];
+    if (!stats)
     {
-        memcpy(msg.data + msg.header.name_length, position, data_size);
-        if (sendto(mySocket, &msg, sizeof(msg), 0, (const struct sockaddr *)&clientAddr, sizeof(clientAddr)) < 0)
-        {
-            close(mySocket);
-            throw StreamException("Cannot send", errno);
-        }
-        msg.header.part_id++;
-        position += available_space;
-        usleep(frame_parts_delay);
+        stats = stream_stats.get(name);
     }
+    return *stats;
 }
 
 }; // namespace farshow
@@ -0,0 +1,408 @@
+#include "farshow/iouring.hpp"
+#include "farshow/streamexception.hpp"
+#include "farshow/udpinterface.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// Number of buffers provided for received datagrams
+#define RECEIVE_BUFFERS 256
+/// Number of datagrams sent in one batch
+#define SEND_BATCH 64
+/// Buffer group id of the provided buffers
+#define BUFFER_GROUP 0
+
+/// Tags of submissions, telling apart their completions
+#define RECEIVE_TAG 1
+#define SEND_TAG 2
+#define PROVIDE_TAG 3
+#define SHUTDOWN_TAG 4
+
+namespace farshow
+{
+
+/// Size of a provided buffer - recvmsg header, ancillary data and the largest datagram
+static const size_t receive_buffer_size = sizeof(io_uring_recvmsg_out) + CONTROL_SIZE + sizeof(FrameMessage);
+
+IoUring::IoUring(unsigned entries)
+{
+    io_uring_params params = {};
+    fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+    {
+        throw StreamException("Cannot set up io_uring", errno);
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+    {
+        int error = errno;
+        close(fd);
+        throw StreamException("Cannot map io_uring submission queue", error);
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cq_ring = sq_ring;
+    }
+    else
+    {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+        {
+            int error = errno;
+            munmap(sq_ring, sq_ring_size);
+            close(fd);
+            throw StreamException("Cannot map io_uring completion queue", error);
+        }
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe *)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        int error = errno;
+        if (cq_ring != sq_ring)
+        {
+            munmap(cq_ring, cq_ring_size);
+        }
+        munmap(sq_ring, sq_ring_size);
+        close(fd);
+        throw StreamException("Cannot map io_uring submission entries", error);
+    }
+
+    char *sq = (char *)sq_ring;
+    char *cq = (char *)cq_ring;
+    sq_head = (unsigned *)(sq + params.sq_off.head);
+    sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq + params.sq_off.array);
+    cq_head = (unsigned *)(cq + params.cq_off.head);
+    cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    sq_entries = params.sq_entries;
+    local_tail = *sq_tail;
+}
+
+IoUring::~IoUring()
+{
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring)
+    {
+        munmap(cq_ring, cq_ring_size);
+    }
+    munmap(sq_ring, sq_ring_size);
+    close(fd);
+}
+
+io_uring_sqe *IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (local_tail - head >= sq_entries)
+    {
+        return nullptr;
+    }
+    unsigned index = local_tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    local_tail++;
+    pending++;
+    return sqe;
+}
+
+int IoUring::submit(unsigned wait_nr, const __kernel_timespec *timeout)
+{
+    // Make the entries visible to the kernel
+    __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    io_uring_getevents_arg arg = {};
+    arg.ts = (unsigned long)timeout;
+    if (timeout)
+    {
+        // Available since Linux 5.11, before multishot recvmsg
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    int res;
+    do
+    {
+        res = syscall(__NR_io_uring_enter, fd, pending, wait_nr, flags, timeout ? &arg : nullptr,
+                      timeout ? sizeof(arg) : 0);
+    } while (res < 0 && errno == EINTR);
+    if (res < 0)
+    {
+        return -errno;
+    }
+    pending -= res;
+    return res;
+}
+
+io_uring_cqe *IoUring::peekCqe()
+{
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return nullptr;
+    }
+    return &cqes[head & *cq_mask];
+}
+
+void IoUring::seenCqe() { __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE); }
+
+//------------------------- TRANSPORT --------------------------
+
+IoUringTransport::IoUringTransport(int socket, const sockaddr_in &address)
+    : ring(2 * SEND_BATCH), socket(socket), address(address), slots(SEND_BATCH)
+{
+    for (auto &slot : slots)
+    {
+        slot.data.resize(sizeof(FrameMessage));
+        slot.iov = {slot.data.data(), 0};
+        slot.msg = {};
+        slot.msg.msg_name = &this->address;
+        slot.msg.msg_namelen = sizeof(this->address);
+        slot.msg.msg_iov = &slot.iov;
+        slot.msg.msg_iovlen = 1;
+    }
+    receive_msg.msg_controllen = CONTROL_SIZE;
+}
+
+IoUringTransport::~IoUringTransport() { delete[] buffers; }
+
+int IoUringTransport::setupReceive()
+{
+    buffers = new char[RECEIVE_BUFFERS * receive_buffer_size];
+
+    // Provide all buffers at once and wait for the result, to know if the kernel supports it
+    io_uring_sqe *sqe = ring.getSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = RECEIVE_BUFFERS;
+    sqe->addr = (unsigned long)buffers;
+    sqe->len = receive_buffer_size;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = PROVIDE_TAG;
+    int res = ring.submit(1);
+    if (res < 0)
+    {
+        return res;
+    }
+    io_uring_cqe *cqe = ring.peekCqe();
+    res = cqe->res;
+    ring.seenCqe();
+    return res < 0 ? res : 0;
+}
+
+void IoUringTransport::recycleBuffer(unsigned id)
+{
+    io_uring_sqe *sqe = ring.getSqe();
+    if (sqe == nullptr)
+    {
+        // The submission queue is full of returned buffers
+        ring.submit();
+        sqe = ring.getSqe();
+    }
+    // Submitted together with the next wait for datagrams, only failures produce completions
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = (unsigned long)(buffers + id * receive_buffer_size);
+    sqe->len = receive_buffer_size;
+    sqe->off = id;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = PROVIDE_TAG;
+}
+
+void IoUringTransport::armReceive()
+{
+    io_uring_sqe *sqe = ring.getSqe();
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = socket;
+    sqe->addr = (unsigned long)&receive_msg;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = RECEIVE_TAG;
+    armed = true;
+
+    if (!watching)
+    {
+        // Pending recvmsg isn't completed when the socket is shut down, so wait for the shutdown separately
+        sqe = ring.getSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = socket;
+        sqe->poll32_events = POLLRDHUP;
+        sqe->user_data = SHUTDOWN_TAG;
+        watching = true;
+    }
+}
+
+long IoUringTransport::receive(const char *&data, msghdr &control, std::chrono::steady_clock::time_point deadline)
+{
+    if (shut_down)
+    {
+        return 0;
+    }
+    if (buffers == nullptr)
+    {
+        // Senders don't need the buffers, so they're set up on the first receive
+        int res = setupReceive();
+        if (res < 0)
+        {
+            return res;
+        }
+    }
+    if (used_buffer >= 0)
+    {
+        recycleBuffer(used_buffer);
+        used_buffer = -1;
+    }
+
+    while (true)
+    {
+        io_uring_cqe *cqe = ring.peekCqe();
+        if (cqe == nullptr)
+        {
+            if (!armed)
+            {
+                armReceive();
+            }
+            int res;
+            if (deadline == std::chrono::steady_clock::time_point::max())
+            {
+                res = ring.submit(1);
+            }
+            else
+            {
+                auto left = std::max(deadline - std::chrono::steady_clock::now(), std::chrono::nanoseconds::zero());
+                auto seconds = std::chrono::duration_cast<std::chrono::seconds>(left);
+                __kernel_timespec timeout = {seconds.count(), (left - seconds).count()};
+                // -ETIME once the deadline has passed and there's nothing left to submit
+                res = ring.submit(1, &timeout);
+            }
+            if (res < 0)
+            {
+                return res;
+            }
+            continue;
+        }
+
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        unsigned long tag = cqe->user_data;
+        ring.seenCqe();
+        if (tag == SHUTDOWN_TAG)
+        {
+            shut_down = true;
+            return 0;
+        }
+        if (tag != RECEIVE_TAG)
+        {
+            // Failed return of a buffer
+            continue;
+        }
+        if (!(flags & IORING_CQE_F_MORE))
+        {
+            // The multishot recvmsg has finished, it has to be started again
+            armed = false;
+        }
+
+        if (res == -ENOBUFS)
+        {
+            // All buffers were in use, they're available again
+            continue;
+        }
+        if (res < 0)
+        {
+            return res;
+        }
+        if (!(flags & IORING_CQE_F_BUFFER))
+        {
+            // No data - the socket was shut down
+            return 0;
+        }
+
+        used_buffer = flags >> IORING_CQE_BUFFER_SHIFT;
+        char *buffer = buffers + used_buffer * receive_buffer_size;
+        io_uring_recvmsg_out *out = (io_uring_recvmsg_out *)buffer;
+        control.msg_control = buffer + sizeof(io_uring_recvmsg_out) + receive_msg.msg_namelen;
+        control.msg_controllen = out->controllen;
+        data = buffer + sizeof(io_uring_recvmsg_out) + receive_msg.msg_namelen + receive_msg.msg_controllen;
+        return out->payloadlen;
+    }
+}
+
+int IoUringTransport::send(const void *data, size_t size)
+{
+    if (queued == slots.size())
+    {
+        int res = flush();
+        if (res < 0)
+        {
+            return res;
+        }
+    }
+
+    SendSlot &slot = slots[queued++];
+    memcpy(slot.data.data(), data, size);
+    slot.iov.iov_len = size;
+
+    io_uring_sqe *sqe = ring.getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = socket;
+    sqe->addr = (unsigned long)&slot.msg;
+    sqe->user_data = SEND_TAG;
+    return 0;
+}
+
+int IoUringTransport::flush()
+{
+    if (queued == 0)
+    {
+        return 0;
+    }
+
+    int res = ring.submit(queued);
+    if (res < 0)
+    {
+        return res;
+    }
+
+    int error = 0;
+    for (unsigned completed = 0; completed < queued;)
+    {
+        io_uring_cqe *cqe = ring.peekCqe();
+        if (cqe == nullptr)
+        {
+            res = ring.submit(queued - completed);
+            if (res < 0)
+            {
+                return res;
+            }
+            continue;
+        }
+        if (cqe->user_data == SEND_TAG)
+        {
+            if (cqe->res < 0 && error == 0)
+            {
+                error = cqe->res;
+            }
+            completed++;
+        }
+        ring.seenCqe();
+    }
+    queued = 0;
+    return error;
+}
+
+}; // namespace farshow
@@ -0,0 +1,182 @@
+#include "farshow/jpegdecoder.hpp"
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <jpeglib.h>
+#include <vector>
+
+namespace farshow
+{
+
+/**
+ * libjpeg error manager returning to the decoding function instead of exiting the process
+ */
+struct JpegError
+{
+    jpeg_error_mgr manager; ///< libjpeg's fields, has to be the first member
+    jmp_buf jump;           ///< where to return on error
+};
+
+static void exitOnError(j_common_ptr info)
+{
+    longjmp(((JpegError *)info->err)->jump, 1);
+}
+
+static void skipMessage(j_common_ptr) {}
+
+/**
+ * Checks the SOI marker at the beginning of the frame
+ *
+ * @param encoded Complete, encoded frame
+ *
+ * @returns True if the frame is a JPEG image
+ */
+static bool isJpeg(const EncodedFrame &encoded)
+{
+    return encoded.size >= 2 && encoded.data[0] == 0xFF && encoded.data[1] == 0xD8;
+}
+
+bool decodeJpegYuv(const EncodedFrame &encoded, Frame &frame)
+{
+    if (!isJpeg(encoded))
+    {
+        return false;
+    }
+
+    jpeg_decompress_struct info;
+    JpegError error;
+    // Everything destroyed after an error is created before setjmp
+    cv::Mat img;
+    std::vector<uchar> rows[3];
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = exitOnError;
+    error.manager.output_message = skipMessage;
+    if (setjmp(error.jump))
+    {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, encoded.data, encoded.size);
+    jpeg_read_header(&info, TRUE);
+    jpeg_component_info *components = info.comp_info;
+    if (info.jpeg_color_space != JCS_YCbCr || info.num_components != 3 || components[0].h_samp_factor != 2 ||
+        components[0].v_samp_factor != 2 || components[1].h_samp_factor != 1 || components[1].v_samp_factor != 1 ||
+        components[2].h_samp_factor != 1 || components[2].v_samp_factor != 1 || info.image_width % 2 != 0 ||
+        info.image_height % 2 != 0)
+    {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    info.raw_data_out = TRUE;
+    info.out_color_space = JCS_YCbCr;
+    info.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&info);
+
+    int width = info.image_width;
+    int height = info.image_height;
+    img.create(height * 3 / 2, width, CV_8UC1);
+    uchar *planes[3] = {img.data, img.data + width * height, img.data + width * height * 5 / 4};
+    int plane_widths[3] = {width, width / 2, width / 2};
+    int plane_heights[3] = {height, height / 2, height / 2};
+
+    // libjpeg writes whole blocks, so it gets rows padded to them and the visible part is copied to the planes
+    JSAMPROW row_pointers[3][2 * DCTSIZE];
+    JSAMPARRAY plane_rows[3];
+    int strides[3];
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int lines = components[plane].v_samp_factor * DCTSIZE;
+        strides[plane] = components[plane].width_in_blocks * DCTSIZE;
+        rows[plane].resize(strides[plane] * lines);
+        for (int line = 0; line < lines; line++)
+        {
+            row_pointers[plane][line] = rows[plane].data() + line * strides[plane];
+        }
+        plane_rows[plane] = row_pointers[plane];
+    }
+
+    while (info.output_scanline < info.output_height)
+    {
+        int first_line = info.output_scanline;
+        jpeg_read_raw_data(&info, plane_rows, 2 * DCTSIZE);
+        for (int plane = 0; plane < 3; plane++)
+        {
+            int divisor = plane == 0 ? 1 : 2;
+            int first_row = first_line / divisor;
+            int count = std::min(2 * DCTSIZE / divisor, plane_heights[plane] - first_row);
+            for (int row = 0; row < count; row++)
+            {
+                memcpy(planes[plane] + (first_row + row) * plane_widths[plane], row_pointers[plane][row],
+                       plane_widths[plane]);
+            }
+        }
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    frame.img = img;
+    frame.format = PixelFormat::I420;
+    return true;
+}
+
+bool decodeJpegScaled(const EncodedFrame &encoded, Frame &frame, cv::Size size)
+{
+    if (!isJpeg(encoded))
+    {
+        return false;
+    }
+
+    jpeg_decompress_struct info;
+    JpegError error;
+    cv::Mat img;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = exitOnError;
+    error.manager.output_message = skipMessage;
+    if (setjmp(error.jump))
+    {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, encoded.data, encoded.size);
+    jpeg_read_header(&info, TRUE);
+    if (info.jpeg_color_space != JCS_YCbCr && info.jpeg_color_space != JCS_GRAYSCALE &&
+        info.jpeg_color_space != JCS_RGB)
+    {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    // The smallest scale still covering the size (rounding up, like libjpeg)
+    unsigned denominator = 8;
+    while (denominator > 1 && ((info.image_width + denominator - 1) / denominator < (unsigned)size.width ||
+                               (info.image_height + denominator - 1) / denominator < (unsigned)size.height))
+    {
+        denominator /= 2;
+    }
+    info.scale_num = 1;
+    info.scale_denom = denominator;
+    info.out_color_space = JCS_EXT_BGR;
+    info.dct_method = JDCT_IFAST;
+    jpeg_start_decompress(&info);
+
+    img.create(info.output_height, info.output_width, CV_8UC3);
+    while (info.output_scanline < info.output_height)
+    {
+        JSAMPROW row = img.ptr(info.output_scanline);
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    frame.img = img;
+    frame.format = PixelFormat::NATIVE;
+    return true;
+}
+
+}; // namespace farshow
@@ -0,0 +1,36 @@
+#include "farshow/framemailbox.hpp"
+#include <pybind11/chrono.h>
+#include <pybind11/pybind11.h>
+
+namespace py = pybind11;
+
+void initFrameMailbox(py::module &m)
+{
+    py::class_<farshow::FrameMailbox, std::shared_ptr<farshow::FrameMailbox>>(m, "FrameMailbox")
+        .def(py::init<farshow::DeliveryMode, size_t>(), py::arg("mode") = farshow::DeliveryMode::LATEST,
+             py::arg("capacity") = 1)
+        .def("put", &farshow::FrameMailbox::put, py::arg("frame"))
+        .def(
+            "tryTake",
+            [](farshow::FrameMailbox &self) -> py::object
+            {
+                farshow::Frame frame;
+                return self.tryTake(frame) ? py::cast(frame) : py::none();
+            })
+        .def(
+            "take",
+            [](farshow::FrameMailbox &self, std::chrono::milliseconds timeout) -> py::object
+            {
+                farshow::Frame frame;
+                bool taken;
+                {
+                    py::gil_scoped_release release;
+                    taken = self.take(frame, timeout);
+                }
+                return taken ? py::cast(frame) : py::none();
+            },
+            py::arg("timeout"))
+        .def("close", &farshow::FrameMailbox::close)
+        .def("isClosed", &farshow::FrameMailbox::isClosed)
+        .def("getDropped", &farshow::FrameMailbox::getDropped);
+}
@@ -1,5 +1,9 @@
 #include "farshow/framereceiver.hpp"
+#include "farshow/framemailbox.hpp"
+#include "farshow/framerecorder.hpp"
 #include "cvnp/cvnp.h"
+#include <pybind11/chrono.h>
+#include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
@@ -11,27 +15,96 @@ PYBIND11_MAKE_OPAQUE(std::vector<uchar>)
 void initFrameReceiver(py::module &m)
 {
     py::bind_vector<std::vector<uchar>>(m, "VectorUchar");
+    py::class_<farshow::FrameTimestamps>(m, "FrameTimestamps")
+        .def(py::init<>())
+        .def_readwrite("captured", &farshow::FrameTimestamps::captured)
+        .def_readwrite("encoded", &farshow::FrameTimestamps::encoded)
+        .def_readwrite("first_part", &farshow::FrameTimestamps::first_part)
+        .def_readwrite("last_part", &farshow::FrameTimestamps::last_part)
+        .def_readwrite("reassembled", &farshow::FrameTimestamps::reassembled)
+        .def_readwrite("decoded", &farshow::FrameTimestamps::decoded);
+    py::enum_<farshow::PixelFormat>(m, "PixelFormat")
+        .value("NATIVE", farshow::PixelFormat::NATIVE)
+        .value("I420", farshow::PixelFormat::I420);
     py::class_<farshow::Frame>(m, "Frame")
         .def(py::init(
                  [](const std::string &name, py::array &a) {
-                     return farshow::Frame{name, cvnp::nparray_to_mat(a)};
+                     return farshow::Frame{name, cvnp::nparray_to_mat(a), {}};
                  }),
              py::arg("name"), py::arg("img"))
         .def_readwrite("name", &farshow::Frame::name)
+        .def_readwrite("timestamps", &farshow::Frame::timestamps)
+        .def_readwrite("format", &farshow::Frame::format)
         .def_property(
             "img", [](farshow::Frame &self) { return cvnp::mat_to_nparray(self.img, true); },
             [](farshow::Frame &self, py::array &a) { self.img = cvnp::nparray_to_mat(a); });
+    py::class_<farshow::EncodedFrame>(m, "EncodedFrame")
+        .def_readonly("name", &farshow::EncodedFrame::name)
+        .def_readonly("id", &farshow::EncodedFrame::id)
+        .def_readonly("timestamps", &farshow::EncodedFrame::timestamps)
+        .def_property_readonly("data", [](const farshow::EncodedFrame &self)
+                               { return py::bytes((const char *)self.data, self.size); });
+    py::enum_<farshow::DeliveryMode>(m, "DeliveryMode")
+        .value("LATEST", farshow::DeliveryMode::LATEST)
+        .value("QUEUE", farshow::DeliveryMode::QUEUE);
+    py::enum_<farshow::FilterMode>(m, "FilterMode")
+        .value("ALLOW", farshow::FilterMode::ALLOW)
+        .value("DENY", farshow::FilterMode::DENY);
+    py::class_<farshow::ReassemblyLimits>(m, "ReassemblyLimits")
+        .def(py::init<>())
+        .def_readwrite("max_stream_bytes", &farshow::ReassemblyLimits::max_stream_bytes)
+        .def_readwrite("max_total_bytes", &farshow::ReassemblyLimits::max_total_bytes)
+        .def_readwrite("max_frame_age", &farshow::ReassemblyLimits::max_frame_age)
+        .def_readwrite("max_streams", &farshow::ReassemblyLimits::max_streams)
+        .def_readwrite("max_receive_buffer", &farshow::ReassemblyLimits::max_receive_buffer);
+    py::class_<farshow::ReassemblyStats>(m, "ReassemblyStats")
+        .def_readonly("evicted_frames", &farshow::ReassemblyStats::evicted_frames)
+        .def_readonly("evicted_bytes", &farshow::ReassemblyStats::evicted_bytes)
+        .def_readonly("evicted_streams", &farshow::ReassemblyStats::evicted_streams)
+        .def_readonly("used_bytes", &farshow::ReassemblyStats::used_bytes)
+        .def_readonly("duplicate_parts", &farshow::ReassemblyStats::duplicate_parts)
+        .def_readonly("invalid_parts", &farshow::ReassemblyStats::invalid_parts)
+        .def_readonly("dropped_frames", &farshow::ReassemblyStats::dropped_frames)
+        .def_readonly("lost_parts", &farshow::ReassemblyStats::lost_parts)
+        .def_readonly("kernel_drops", &farshow::ReassemblyStats::kernel_drops)
+        .def_readonly("receive_buffer", &farshow::ReassemblyStats::receive_buffer);
     py::class_<farshow::FrameContainer>(m, "FrameContainer")
-        .def(py::init<unsigned, unsigned, const std::string &, unsigned>(), py::arg("id"), py::arg("total_parts"),
-             py::arg("name"), py::arg("frame_size"))
+        .def(py::init<unsigned, unsigned, unsigned, unsigned>(), py::arg("id"), py::arg("total_parts"),
+             py::arg("frame_size"), py::arg("part_size") = 0)
+        .def("markPart", &farshow::FrameContainer::markPart, py::arg("part_id"))
+        .def("hasPart", &farshow::FrameContainer::hasPart, py::arg("part_id"))
         .def("isComplete", &farshow::FrameContainer::isComplete)
         .def_readwrite("id", &farshow::FrameContainer::id)
         .def_readwrite("total_parts", &farshow::FrameContainer::total_parts)
         .def_readwrite("added_parts", &farshow::FrameContainer::added_parts)
-        .def_readwrite("img", &farshow::FrameContainer::img)
-        .def_readwrite("name", &farshow::FrameContainer::name);
+        .def_readwrite("part_size", &farshow::FrameContainer::part_size)
+        .def_readwrite("img", &farshow::FrameContainer::img);
     py::class_<farshow::FrameReceiver>(m, "FrameReceiver")
-        .def(py::init<const std::string &, int>(), py::arg("client_address") = "", py::arg("client_port") = 1100)
+        .def(py::init<const std::string &, int, farshow::ReassemblyLimits, bool>(), py::arg("client_address") = "",
+             py::arg("client_port") = 1100, py::arg("limits") = farshow::ReassemblyLimits(),
+             py::arg("reuse_port") = false)
         .def("receiveFrame", &farshow::FrameReceiver::receiveFrame)
-        .def("getSocket", &farshow::FrameReceiver::getSocket);
+        .def("getSocket", &farshow::FrameReceiver::getSocket)
+        .def("setReassemblyLimits", &farshow::FrameReceiver::setReassemblyLimits, py::arg("limits"))
+        .def("getReassemblyStats", &farshow::FrameReceiver::getReassemblyStats)
+        .def("getStreamStats", &farshow::FrameReceiver::getStreamStats)
+        .def("setStreamFilter", &farshow::FrameReceiver::setStreamFilter, py::arg("mode"), py::arg("names"))
+        .def("clearStreamFilter", &farshow::FrameReceiver::clearStreamFilter)
+        .def("setStreamVisible", &farshow::FrameReceiver::setStreamVisible, py::arg("name"), py::arg("visible"))
+        .def("setMaxDecodeRate", &farshow::FrameReceiver::setMaxDecodeRate, py::arg("name"), py::arg("rate"))
+        .def("subscribe", py::overload_cast<std::string, farshow::FrameCallback>(&farshow::FrameReceiver::subscribe),
+             py::arg("name"), py::arg("callback"))
+        .def("subscribe",
+             py::overload_cast<std::string, farshow::DeliveryMode, size_t>(&farshow::FrameReceiver::subscribe),
+             py::arg("name"), py::arg("mode") = farshow::DeliveryMode::LATEST, py::arg("capacity") = 1)
+        .def("subscribeEncoded", &farshow::FrameReceiver::subscribeEncoded, py::arg("name"), py::arg("callback"))
+        .def(
+            "subscribeEncoded",
+            [](farshow::FrameReceiver &self, std::string name, std::shared_ptr<farshow::FrameRecorder> recorder)
+            {
+                self.subscribeEncoded(name, [recorder](const farshow::EncodedFrame &frame) { recorder->record(frame); });
+            },
+            py::arg("name"), py::arg("recorder"))
+        .def("unsubscribe", &farshow::FrameReceiver::unsubscribe, py::arg("name"), py::arg("kept") = nullptr)
+        .def("run", &farshow::FrameReceiver::run, py::call_guard<py::gil_scoped_release>());
 }
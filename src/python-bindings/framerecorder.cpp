@@ -0,0 +1,26 @@
+#include "farshow/framerecorder.hpp"
+#include <pybind11/chrono.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+void initFrameRecorder(py::module &m)
+{
+    py::class_<farshow::FrameRecorder, std::shared_ptr<farshow::FrameRecorder>>(m, "FrameRecorder")
+        .def(py::init<const std::string &, size_t, bool, size_t>(), py::arg("directory"),
+             py::arg("segment_size") = size_t(1) << 30, py::arg("direct_io") = false, py::arg("buffer_size") = 8 << 20)
+        .def("record", &farshow::FrameRecorder::record, py::arg("frame"))
+        .def("flush", &farshow::FrameRecorder::flush)
+        .def("close", &farshow::FrameRecorder::close)
+        .def("isDirect", &farshow::FrameRecorder::isDirect)
+        .def("getRecordedFrames", &farshow::FrameRecorder::getRecordedFrames);
+    py::class_<farshow::FrameRecording>(m, "FrameRecording")
+        .def(py::init<const std::string &>(), py::arg("directory"))
+        .def("size", &farshow::FrameRecording::size)
+        .def("__len__", &farshow::FrameRecording::size)
+        .def("getFrame", &farshow::FrameRecording::getFrame, py::arg("index"))
+        .def("seekTime", &farshow::FrameRecording::seekTime, py::arg("time"))
+        .def("seekFrame", &farshow::FrameRecording::seekFrame, py::arg("name"), py::arg("frame_id"))
+        .def("getStreams", &farshow::FrameRecording::getStreams);
+}
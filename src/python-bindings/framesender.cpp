@@ -1,5 +1,6 @@
 #include "farshow/framesender.hpp"
 #include "cvnp/cvnp.h"
+#include <pybind11/chrono.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
@@ -13,12 +14,24 @@ void initFrameSender(py::module &m)
         .def(
             "sendFrame",
             [](farshow::FrameSender &self, py::array &a, std::string &name, std::string &extension,
-               std::vector<int> &encoding_params)
+               std::vector<int> &encoding_params, std::chrono::system_clock::time_point capture_time)
             {
                 cv::Mat mat = cvnp::nparray_to_mat(a);
-                self.sendFrame(mat, name, extension, encoding_params);
+                self.sendFrame(mat, name, extension, encoding_params, capture_time);
             },
             py::arg("frame"), py::arg("name"), py::arg("extension") = ".jpg",
-            py::arg("encoding_params") = std::vector<int>({cv::IMWRITE_JPEG_QUALITY, 95}))
+            py::arg("encoding_params") = std::vector<int>({cv::IMWRITE_JPEG_QUALITY, 95}),
+            py::arg("capture_time") = std::chrono::system_clock::time_point())
+        .def(
+            "sendEncodedFrame",
+            [](farshow::FrameSender &self, py::bytes &data, std::string &name,
+               std::chrono::system_clock::time_point capture_time, std::chrono::system_clock::time_point encode_time)
+            {
+                std::string encoded = data;
+                self.sendEncodedFrame((const uchar *)encoded.data(), encoded.size(), name, capture_time, encode_time);
+            },
+            py::arg("data"), py::arg("name"), py::arg("capture_time") = std::chrono::system_clock::time_point(),
+            py::arg("encode_time") = std::chrono::system_clock::time_point())
+        .def("getStreamStats", &farshow::FrameSender::getStreamStats)
         .def_readwrite("frame_parts_delay", &farshow::FrameSender::frame_parts_delay);
 }
@@ -5,13 +5,21 @@ namespace py = pybind11;
 
 void initStreamException(py::module &);
 void initUdpInterface(py::module &);
+void initStats(py::module &);
 void initFrameSender(py::module &);
 void initFrameReceiver(py::module &);
+void initFrameMailbox(py::module &);
+void initFrameRecorder(py::module &);
+void initShardedFrameReceiver(py::module &);
 
 PYBIND11_MODULE(farshow, m)
 {
     initStreamException(m);
     initUdpInterface(m);
+    initStats(m);
     initFrameSender(m);
     initFrameReceiver(m);
+    initFrameMailbox(m);
+    initFrameRecorder(m);
+    initShardedFrameReceiver(m);
 }
@@ -0,0 +1,42 @@
+#include "farshow/framerecorder.hpp"
+#include "farshow/shardedframereceiver.hpp"
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+void initShardedFrameReceiver(py::module &m)
+{
+    py::class_<farshow::ShardedFrameReceiver>(m, "ShardedFrameReceiver")
+        .def(py::init<const std::string &, int, unsigned, farshow::ReassemblyLimits, size_t, farshow::Transport>(),
+             py::arg("client_address") = "", py::arg("client_port") = 1100, py::arg("shards") = 0,
+             py::arg("limits") = farshow::ReassemblyLimits(), py::arg("queue_capacity") = 64,
+             py::arg("transport") = farshow::Transport::SOCKET)
+        .def("receiveFrame", &farshow::ShardedFrameReceiver::receiveFrame, py::call_guard<py::gil_scoped_release>())
+        .def("subscribe",
+             py::overload_cast<std::string, farshow::FrameCallback>(&farshow::ShardedFrameReceiver::subscribe),
+             py::arg("name"), py::arg("callback"))
+        .def("subscribe",
+             py::overload_cast<std::string, farshow::DeliveryMode, size_t>(&farshow::ShardedFrameReceiver::subscribe),
+             py::arg("name"), py::arg("mode") = farshow::DeliveryMode::LATEST, py::arg("capacity") = 1)
+        .def("subscribeEncoded", &farshow::ShardedFrameReceiver::subscribeEncoded, py::arg("name"),
+             py::arg("callback"))
+        .def(
+            "subscribeEncoded",
+            [](farshow::ShardedFrameReceiver &self, std::string name, std::shared_ptr<farshow::FrameRecorder> recorder)
+            {
+                self.subscribeEncoded(name, [recorder](const farshow::EncodedFrame &frame) { recorder->record(frame); });
+            },
+            py::arg("name"), py::arg("recorder"))
+        .def("unsubscribe", &farshow::ShardedFrameReceiver::unsubscribe, py::arg("name"))
+        .def("setStreamFilter", &farshow::ShardedFrameReceiver::setStreamFilter, py::arg("mode"), py::arg("names"))
+        .def("clearStreamFilter", &farshow::ShardedFrameReceiver::clearStreamFilter)
+        .def("setStreamVisible", &farshow::ShardedFrameReceiver::setStreamVisible, py::arg("name"), py::arg("visible"))
+        .def("setMaxDecodeRate", &farshow::ShardedFrameReceiver::setMaxDecodeRate, py::arg("name"), py::arg("rate"))
+        .def("getReassemblyStats", &farshow::ShardedFrameReceiver::getReassemblyStats)
+        .def("getStreamStats", &farshow::ShardedFrameReceiver::getStreamStats)
+        .def("isSteered", &farshow::ShardedFrameReceiver::isSteered)
+        .def("getShardCount", &farshow::ShardedFrameReceiver::getShardCount)
+        .def("stop", &farshow::ShardedFrameReceiver::stop);
+}
@@ -0,0 +1,37 @@
+#include "farshow/stats.hpp"
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+void initStats(py::module &m)
+{
+    py::class_<farshow::HistogramSnapshot>(m, "HistogramSnapshot")
+        .def_readonly("buckets", &farshow::HistogramSnapshot::buckets)
+        .def_readonly("count", &farshow::HistogramSnapshot::count)
+        .def_readonly("total_us", &farshow::HistogramSnapshot::total_us)
+        .def_readonly("max_us", &farshow::HistogramSnapshot::max_us)
+        .def("mean", &farshow::HistogramSnapshot::mean)
+        .def("percentile", &farshow::HistogramSnapshot::percentile, py::arg("percent"));
+    py::class_<farshow::SenderStreamSnapshot>(m, "SenderStreamSnapshot")
+        .def_readonly("frames", &farshow::SenderStreamSnapshot::frames)
+        .def_readonly("bytes", &farshow::SenderStreamSnapshot::bytes)
+        .def_readonly("parts", &farshow::SenderStreamSnapshot::parts)
+        .def_readonly("drops", &farshow::SenderStreamSnapshot::drops)
+        .def_readonly("encode_time", &farshow::SenderStreamSnapshot::encode_time)
+        .def_readonly("send_time", &farshow::SenderStreamSnapshot::send_time);
+    py::class_<farshow::ReceiverStreamSnapshot>(m, "ReceiverStreamSnapshot")
+        .def_readonly("packets", &farshow::ReceiverStreamSnapshot::packets)
+        .def_readonly("bytes", &farshow::ReceiverStreamSnapshot::bytes)
+        .def_readonly("duplicate_parts", &farshow::ReceiverStreamSnapshot::duplicate_parts)
+        .def_readonly("dropped_frames", &farshow::ReceiverStreamSnapshot::dropped_frames)
+        .def_readonly("lost_parts", &farshow::ReceiverStreamSnapshot::lost_parts)
+        .def_readonly("missing_frames", &farshow::ReceiverStreamSnapshot::missing_frames)
+        .def_readonly("evicted_frames", &farshow::ReceiverStreamSnapshot::evicted_frames)
+        .def_readonly("frames", &farshow::ReceiverStreamSnapshot::frames)
+        .def_readonly("complete_frames", &farshow::ReceiverStreamSnapshot::complete_frames)
+        .def_readonly("skipped_frames", &farshow::ReceiverStreamSnapshot::skipped_frames)
+        .def_readonly("reassembly_time", &farshow::ReceiverStreamSnapshot::reassembly_time)
+        .def_readonly("decode_time", &farshow::ReceiverStreamSnapshot::decode_time)
+        .def_readonly("fps", &farshow::ReceiverStreamSnapshot::fps);
+}
@@ -5,12 +5,23 @@ namespace py = pybind11;
 void initUdpInterface(py::module &m)
 {
     py::class_<farshow::FrameHeader>(m, "FrameHeader")
-        .def(py::init<unsigned, unsigned, unsigned, unsigned>(), py::arg("name_length"), py::arg("frame_id"),
-             py::arg("part_id"), py::arg("total_parts"))
+        .def(py::init(
+                 [](unsigned name_length, unsigned frame_id, unsigned part_id, unsigned total_parts,
+                    uint64_t capture_time, uint64_t encode_time)
+                 {
+                     return farshow::FrameHeader{FRAME_MAGIC, FRAME_VERSION, name_length,  frame_id,
+                                                 part_id,     total_parts,   capture_time, encode_time};
+                 }),
+             py::arg("name_length"), py::arg("frame_id"), py::arg("part_id"), py::arg("total_parts"),
+             py::arg("capture_time") = 0, py::arg("encode_time") = 0)
+        .def_readwrite("magic", &farshow::FrameHeader::magic)
+        .def_readwrite("version", &farshow::FrameHeader::version)
         .def_readwrite("name_length", &farshow::FrameHeader::name_length)
         .def_readwrite("frame_id", &farshow::FrameHeader::frame_id)
         .def_readwrite("part_id", &farshow::FrameHeader::part_id)
-        .def_readwrite("total_parts", &farshow::FrameHeader::total_parts);
+        .def_readwrite("total_parts", &farshow::FrameHeader::total_parts)
+        .def_readwrite("capture_time", &farshow::FrameHeader::capture_time)
+        .def_readwrite("encode_time", &farshow::FrameHeader::encode_time);
     py::class_<farshow::FrameMessage>(m, "FrameMessage")
         .def(py::init(
                  [](farshow::FrameHeader header, std::string &data)
@@ -25,6 +36,11 @@ void initUdpInterface(py::module &m)
             "data", [](farshow::FrameMessage &self) { return self.data; },
             [](farshow::FrameMessage &self, std::string &a)
             { std::strncpy(self.data, a.c_str(), sizeof(self.data) / sizeof(self.data[0])); });
+    py::enum_<farshow::Transport>(m, "Transport")
+        .value("SOCKET", farshow::Transport::SOCKET)
+        .value("IO_URING", farshow::Transport::IO_URING);
     py::class_<farshow::UdpInterface>(m, "UdpInterface")
-        .def(py::init<const std::string &, int>(), py::arg("client_address") = "", py::arg("client_port") = 1100);
+        .def(py::init<const std::string &, int>(), py::arg("client_address") = "", py::arg("client_port") = 1100)
+        .def("setTransport", &farshow::UdpInterface::setTransport, py::arg("transport"))
+        .def("getTransport", &farshow::UdpInterface::getTransport);
 }
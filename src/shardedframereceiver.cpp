@@ -0,0 +1,239 @@
+#include "farshow/shardedframereceiver.hpp"
+#include "farshow/streamexception.hpp"
+
+#include <linux/filter.h>
+#include <sys/socket.h>
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+namespace farshow
+{
+
+/**
+ * Number of leading stream name bytes hashed by the steering program. Classic BPF jumps are limited to 255 instructions,
+ * which limits the unrolled loop.
+ */
+#define STEERING_NAME_BYTES 32
+
+ShardedFrameReceiver::ShardedFrameReceiver(std::string client_address, int client_port, unsigned shard_count,
+                                           ReassemblyLimits limits, size_t queue_capacity, Transport transport)
+    : merged(std::make_shared<FrameMailbox>(DeliveryMode::QUEUE, queue_capacity))
+{
+    if (shard_count == 0)
+    {
+        shard_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The sockets have to be bound in order, because the steering program returns the index of the socket in the group
+    for (unsigned i = 0; i < shard_count; i++)
+    {
+        shards.push_back(std::make_unique<FrameReceiver>(client_address, client_port, limits, true));
+        shards.back()->setTransport(transport);
+        shards.back()->subscribe("", merged);
+    }
+    steered = shard_count == 1 || attachSteeringProgram();
+
+    for (auto &shard : shards)
+    {
+        threads.emplace_back(
+            [this, &shard]()
+            {
+                try
+                {
+                    shard->run();
+                }
+                catch (std::exception &)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    error = std::current_exception();
+                    merged->close();
+                }
+            });
+    }
+}
+
+ShardedFrameReceiver::~ShardedFrameReceiver()
+{
+    stop();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+bool ShardedFrameReceiver::attachSteeringProgram()
+{
+    // The program gets the UDP payload and returns the index of the socket, which should receive it. It computes
+    // `hash = hash * 31 + c` over the stream name (up to the null character), stored right after the header, and
+    // returns `hash % shards`.
+    const unsigned name_offset = sizeof(FrameHeader);
+    const unsigned done = 2 + 7 * STEERING_NAME_BYTES;
+    std::vector<sock_filter> program;
+
+    program.push_back(BPF_STMT(BPF_LD | BPF_IMM, 0));
+    program.push_back(BPF_STMT(BPF_ST, 0));
+    for (unsigned i = 0; i < STEERING_NAME_BYTES; i++)
+    {
+        program.push_back(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, name_offset + i));
+        __u8 to_done = done - (program.size() + 1);
+        program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, to_done, 0));
+        program.push_back(BPF_STMT(BPF_MISC | BPF_TAX, 0));
+        program.push_back(BPF_STMT(BPF_LD | BPF_MEM, 0));
+        program.push_back(BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 31));
+        program.push_back(BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0));
+        program.push_back(BPF_STMT(BPF_ST, 0));
+    }
+    program.push_back(BPF_STMT(BPF_LD | BPF_MEM, 0));
+    program.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (unsigned)shards.size()));
+    program.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+
+    struct sock_fprog fprog = {(unsigned short)program.size(), program.data()};
+    return setsockopt(shards.front()->getSocket(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog)) == 0;
+}
+
+Frame ShardedFrameReceiver::receiveFrame()
+{
+    Frame frame;
+    if (!merged->take(frame))
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+    return frame;
+}
+
+void ShardedFrameReceiver::subscribe(std::string name, FrameCallback callback)
+{
+    for (auto &shard : shards)
+    {
+        shard->subscribe(name, callback);
+    }
+}
+
+void ShardedFrameReceiver::subscribeEncoded(std::string name, EncodedFrameCallback callback)
+{
+    for (auto &shard : shards)
+    {
+        shard->subscribeEncoded(name, callback);
+    }
+}
+
+std::shared_ptr<FrameMailbox> ShardedFrameReceiver::subscribe(std::string name, DeliveryMode mode, size_t capacity)
+{
+    auto mailbox = std::make_shared<FrameMailbox>(mode, capacity);
+    for (auto &shard : shards)
+    {
+        shard->subscribe(name, mailbox);
+    }
+    return mailbox;
+}
+
+void ShardedFrameReceiver::unsubscribe(std::string name)
+{
+    // The merged mailbox keeps feeding `receiveFrame`
+    for (auto &shard : shards)
+    {
+        shard->unsubscribe(name, merged);
+    }
+}
+
+void ShardedFrameReceiver::setStreamFilter(FilterMode mode, std::vector<std::string> names)
+{
+    for (auto &shard : shards)
+    {
+        shard->setStreamFilter(mode, names);
+    }
+}
+
+void ShardedFrameReceiver::clearStreamFilter()
+{
+    for (auto &shard : shards)
+    {
+        shard->clearStreamFilter();
+    }
+}
+
+std::optional<Frame> ShardedFrameReceiver::setStreamVisible(const std::string &name, bool visible)
+{
+    // Without steering, the stream could have moved between the shards – the newest kept frame is returned
+    std::optional<Frame> newest;
+    for (auto &shard : shards)
+    {
+        std::optional<Frame> frame = shard->setStreamVisible(name, visible);
+        if (frame && (!newest || frame->timestamps.reassembled > newest->timestamps.reassembled))
+        {
+            newest = std::move(frame);
+        }
+    }
+    return newest;
+}
+
+void ShardedFrameReceiver::setMaxDecodeRate(const std::string &name, float rate)
+{
+    for (auto &shard : shards)
+    {
+        shard->setMaxDecodeRate(name, rate);
+    }
+}
+
+void ShardedFrameReceiver::setDecoder(FrameDecoder decoder)
+{
+    for (auto &shard : shards)
+    {
+        shard->setDecoder(decoder);
+    }
+}
+
+ReassemblyStats ShardedFrameReceiver::getReassemblyStats()
+{
+    ReassemblyStats total{};
+    for (auto &shard : shards)
+    {
+        ReassemblyStats stats = shard->getReassemblyStats();
+        total.evicted_frames += stats.evicted_frames;
+        total.evicted_bytes += stats.evicted_bytes;
+        total.evicted_streams += stats.evicted_streams;
+        total.used_bytes += stats.used_bytes;
+        total.duplicate_parts += stats.duplicate_parts;
+        total.invalid_parts += stats.invalid_parts;
+        total.dropped_frames += stats.dropped_frames;
+        total.lost_parts += stats.lost_parts;
+        total.kernel_drops += stats.kernel_drops;
+        total.receive_buffer += stats.receive_buffer;
+    }
+    return total;
+}
+
+std::unordered_map<std::string, ReceiverStreamSnapshot> ShardedFrameReceiver::getStreamStats()
+{
+    // Without steering, parts of a stream can reach different shards
+    std::unordered_map<std::string, ReceiverStreamSnapshot> total;
+    for (auto &shard : shards)
+    {
+        for (auto &stream : shard->getStreamStats())
+        {
+            total[stream.first].merge(stream.second);
+        }
+    }
+    return total;
+}
+
+void ShardedFrameReceiver::stop()
+{
+    if (stopped)
+    {
+        return;
+    }
+    stopped = true;
+    for (auto &shard : shards)
+    {
+        shutdown(shard->getSocket(), SHUT_RDWR); // To stop the shard thread, blocked on recv
+    }
+}
+
+}; // namespace farshow
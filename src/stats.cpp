@@ -0,0 +1,160 @@
+#include "farshow/stats.hpp"
+
+#include <algorithm>
+#include <bit>
+
+/// Weight of the newest interval in the smoothed frame interval
+#define INTERVAL_SMOOTHING 0.1
+
+namespace farshow
+{
+
+uint64_t HistogramSnapshot::percentile(double percent) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(percent / 100 * count + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return std::min<uint64_t>(uint64_t(1) << i, max_us);
+        }
+    }
+    return max_us;
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot &other)
+{
+    buckets.resize(std::max(buckets.size(), other.buckets.size()), 0);
+    for (size_t i = 0; i < other.buckets.size(); i++)
+    {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    total_us += other.total_us;
+    max_us = std::max(max_us, other.max_us);
+}
+
+void Histogram::record(std::chrono::nanoseconds duration)
+{
+    uint64_t us = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    unsigned bucket = std::min<unsigned>(std::bit_width(us), HISTOGRAM_BUCKETS - 1);
+
+    // Only the order of each counter matters, the counters don't have to be consistent with each other
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    total_us.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = max_us.load(std::memory_order_relaxed);
+    while (us > max && !max_us.compare_exchange_weak(max, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+HistogramSnapshot Histogram::snapshot() const
+{
+    HistogramSnapshot result;
+    result.buckets.reserve(buckets.size());
+    for (auto &bucket : buckets)
+    {
+        result.buckets.push_back(bucket.load(std::memory_order_relaxed));
+    }
+    result.count = count.load(std::memory_order_relaxed);
+    result.total_us = total_us.load(std::memory_order_relaxed);
+    result.max_us = max_us.load(std::memory_order_relaxed);
+    return result;
+}
+
+void SenderStreamSnapshot::merge(const SenderStreamSnapshot &other)
+{
+    frames += other.frames;
+    bytes += other.bytes;
+    parts += other.parts;
+    drops += other.drops;
+    encode_time.merge(other.encode_time);
+    send_time.merge(other.send_time);
+}
+
+SenderStreamSnapshot SenderStreamStats::snapshot() const
+{
+    SenderStreamSnapshot result;
+    result.frames = frames;
+    result.bytes = bytes;
+    result.parts = parts;
+    result.drops = drops;
+    result.encode_time = encode_time.snapshot();
+    result.send_time = send_time.snapshot();
+    return result;
+}
+
+void ReceiverStreamSnapshot::merge(const ReceiverStreamSnapshot &other)
+{
+    packets += other.packets;
+    bytes += other.bytes;
+    duplicate_parts += other.duplicate_parts;
+    dropped_frames += other.dropped_frames;
+    lost_parts += other.lost_parts;
+    missing_frames += other.missing_frames;
+    evicted_frames += other.evicted_frames;
+    frames += other.frames;
+    complete_frames += other.complete_frames;
+    skipped_frames += other.skipped_frames;
+    reassembly_time.merge(other.reassembly_time);
+    decode_time.merge(other.decode_time);
+    fps += other.fps;
+}
+
+void ReceiverStreamStats::frameDelivered(std::chrono::steady_clock::time_point now)
+{
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    int64_t last = last_frame.load(std::memory_order_relaxed);
+    if (last != 0)
+    {
+        // Only the receiving thread writes, so the smoothed value doesn't need a read-modify-write loop
+        int64_t interval = frame_interval.load(std::memory_order_relaxed);
+        int64_t current = now_ns - last;
+        frame_interval.store(interval ? interval + (int64_t)(INTERVAL_SMOOTHING * (current - interval)) : current,
+                             std::memory_order_relaxed);
+    }
+    last_frame.store(now_ns, std::memory_order_relaxed);
+    frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+ReceiverStreamSnapshot ReceiverStreamStats::snapshot() const
+{
+    ReceiverStreamSnapshot result;
+    result.packets = packets;
+    result.bytes = bytes;
+    result.duplicate_parts = duplicate_parts;
+    result.dropped_frames = dropped_frames;
+    result.lost_parts = lost_parts;
+    result.missing_frames = missing_frames;
+    result.evicted_frames = evicted_frames;
+    result.frames = frames;
+    result.complete_frames = complete_frames;
+    result.skipped_frames = skipped_frames;
+    result.reassembly_time = reassembly_time.snapshot();
+    result.decode_time = decode_time.snapshot();
+
+    int64_t interval = frame_interval.load(std::memory_order_relaxed);
+    if (interval > 0)
+    {
+        // When the stream stops, the time since the last frame is the best estimate of the interval
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+        int64_t silence = now - last_frame.load(std::memory_order_relaxed);
+        if (silence > 2 * interval)
+        {
+            interval = silence;
+        }
+        result.fps = 1e9 / interval;
+    }
+    return result;
+}
+
+}; // namespace farshow
@@ -0,0 +1,304 @@
+#include "farshow/streamwall.hpp"
+#include "farshow/jpegdecoder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace farshow
+{
+
+/**
+ * Converts the image to 8-bit BGR and shrinks it to fit the cell, keeping its aspect ratio
+ *
+ * @param image Image to convert
+ * @param format Pixel format of the image
+ * @param cell Size of the grid cell, empty to keep the size of the image
+ *
+ * @returns Converted image (the same one, if it already fits)
+ */
+static cv::Mat fitImage(const cv::Mat &image, PixelFormat format, cv::Size cell)
+{
+    cv::Mat img = image;
+    if (format == PixelFormat::I420)
+    {
+        cv::cvtColor(img, img, cv::COLOR_YUV2BGR_I420);
+    }
+
+    double scale = std::min((double)cell.width / img.cols, (double)cell.height / img.rows);
+    if (!cell.empty() && scale < 1)
+    {
+        cv::Size size(std::max(1, (int)(img.cols * scale)), std::max(1, (int)(img.rows * scale)));
+        cv::resize(img, img, size, 0, 0, cv::INTER_AREA);
+    }
+
+    // Convert the smaller image
+    if (img.depth() != CV_8U)
+    {
+        img.convertTo(img, CV_8U, img.depth() == CV_16U ? 1.0 / 256 : 255);
+    }
+    switch (img.channels())
+    {
+    case 2: // gray with alpha
+        cv::extractChannel(img, img, 0);
+        [[fallthrough]];
+    case 1:
+        cv::cvtColor(img, img, cv::COLOR_GRAY2BGR);
+        break;
+    case 4:
+        cv::cvtColor(img, img, cv::COLOR_BGRA2BGR);
+        break;
+    }
+    return img;
+}
+
+bool StreamWall::decode(const EncodedFrame &encoded, Frame &frame)
+{
+    bool is_focused;
+    {
+        std::lock_guard<std::mutex> lock(focused_mutex);
+        is_focused = encoded.name == focused;
+    }
+    if (is_focused)
+    {
+        // When it returns false, the receiver decodes the frame with cv::imdecode
+        return focused_decoder && focused_decoder(encoded, frame);
+    }
+
+    cv::Size tile_cell(cell_width, cell_height);
+    if (!decodeJpegScaled(encoded, frame, tile_cell))
+    {
+        frame.img = cv::imdecode(cv::Mat(1, encoded.size, CV_8UC1, (void *)encoded.data), cv::IMREAD_UNCHANGED);
+        frame.format = PixelFormat::NATIVE;
+    }
+    if (!frame.img.empty())
+    {
+        frame.img = fitImage(frame.img, frame.format, tile_cell);
+    }
+    return true;
+}
+
+void StreamWall::changeFrame(Frame &frame)
+{
+    if (!focused.empty() && frame.name == focused)
+    {
+        if (!focused_window)
+        {
+            focused_window = std::make_unique<FrameWindow>(frame);
+        }
+        else
+        {
+            focused_window->changeFrame(frame);
+        }
+        return;
+    }
+
+    auto tile_id = tile_ids.find(frame.name);
+    if (tile_id == tile_ids.end())
+    {
+        tile_id = tile_ids.emplace(frame.name, tiles.size()).first;
+        tiles.emplace_back();
+        tiles.back().name = frame.name;
+    }
+    Tile &tile = tiles[tile_id->second];
+    // Frames decoded before the stream lost focus or the grid changed don't fit the cell yet
+    tile.img = fitImage(frame.img, frame.format, cell);
+    tile.changed = true;
+}
+
+void StreamWall::focus(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(focused_mutex);
+    focused = name;
+    focused_window.reset();
+}
+
+void StreamWall::layout(ImVec2 size)
+{
+    int count = std::max((int)tiles.size(), 1);
+    int new_columns = std::ceil(std::sqrt(count));
+    int new_rows = (count + new_columns - 1) / new_columns;
+    cv::Size new_cell(std::max((int)size.x / new_columns, 1), std::max((int)size.y / new_rows, 1));
+    if (atlas != 0 && new_columns == columns && new_rows == rows && new_cell == cell)
+    {
+        return;
+    }
+
+    columns = new_columns;
+    rows = new_rows;
+    cell = new_cell;
+    cell_width = cell.width;
+    cell_height = cell.height;
+
+    if (atlas == 0)
+    {
+        glGenTextures(1, &atlas);
+    }
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, columns * cell.width, rows * cell.height, 0, GL_BGR, GL_UNSIGNED_BYTE,
+                 nullptr);
+    for (Tile &tile : tiles)
+    {
+        tile.changed = true;
+    }
+}
+
+void StreamWall::upload()
+{
+    size_t total_size = 0;
+    for (Tile &tile : tiles)
+    {
+        if (tile.changed && !tile.img.empty())
+        {
+            // Images decoded for the previous, bigger grid
+            if (tile.img.cols > cell.width || tile.img.rows > cell.height)
+            {
+                tile.img = fitImage(tile.img, PixelFormat::NATIVE, cell);
+            }
+            total_size += tile.img.cols * tile.img.rows * tile.img.elemSize();
+        }
+    }
+    if (total_size == 0)
+    {
+        return;
+    }
+
+    // All changed tiles go through one pixel buffer, one after another
+    if (pbos[0] == 0)
+    {
+        glGenBuffers(PBO_COUNT, pbos);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[next_pbo]);
+    next_pbo = (next_pbo + 1) % PBO_COUNT;
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, total_size, nullptr, GL_STREAM_DRAW);
+    uchar *buffer = (uchar *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total_size,
+                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!buffer)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+    std::vector<size_t> offsets(tiles.size());
+    size_t offset = 0;
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        cv::Mat &img = tiles[i].img;
+        if (!tiles[i].changed || img.empty())
+        {
+            continue;
+        }
+        offsets[i] = offset;
+        size_t row_size = img.cols * img.elemSize();
+        for (int row = 0; row < img.rows; row++)
+        {
+            memcpy(buffer + offset + row * row_size, img.ptr(row), row_size);
+        }
+        offset += row_size * img.rows;
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        cv::Mat &img = tiles[i].img;
+        if (!tiles[i].changed || img.empty())
+        {
+            continue;
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, i % columns * cell.width, i / columns * cell.height, img.cols, img.rows,
+                        GL_BGR, GL_UNSIGNED_BYTE, (void *)offsets[i]);
+        tiles[i].changed = false;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StreamWall::display()
+{
+    const ImGuiViewport *viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(viewport->WorkPos);
+    ImGui::SetNextWindowSize(viewport->WorkSize);
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0);
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowRounding, 0);
+    // The wall stays behind the window of the focused stream
+    ImGui::Begin("Wall", NULL,
+                 ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings |
+                     ImGuiWindowFlags_NoBringToFrontOnFocus | ImGuiWindowFlags_NoScrollWithMouse);
+    ImGui::PopStyleVar(3);
+
+    ImVec2 origin = ImGui::GetWindowPos();
+    layout(ImGui::GetWindowSize());
+    upload();
+
+    // All images come from the atlas, so Dear ImGui merges them into one draw call – the labels (drawn with the font
+    // texture) are added after them, not to split it
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+    ImVec2 atlas_size(columns * cell.width, rows * cell.height);
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        cv::Mat &img = tiles[i].img;
+        if (img.empty())
+        {
+            continue;
+        }
+        int x = i % columns * cell.width;
+        int y = i / columns * cell.height;
+        float scale = std::min((float)cell.width / img.cols, (float)cell.height / img.rows);
+        ImVec2 start(origin.x + x + (cell.width - img.cols * scale) / 2,
+                     origin.y + y + (cell.height - img.rows * scale) / 2);
+        ImVec2 end(start.x + img.cols * scale, start.y + img.rows * scale);
+        // Half a texel inside the image, so the filtering doesn't blend in the neighbouring tiles
+        ImVec2 uv_start((x + 0.5f) / atlas_size.x, (y + 0.5f) / atlas_size.y);
+        ImVec2 uv_end((x + img.cols - 0.5f) / atlas_size.x, (y + img.rows - 0.5f) / atlas_size.y);
+        draw_list->AddImage((void *)(intptr_t)atlas, start, end, uv_start, uv_end);
+    }
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        ImVec2 start(origin.x + i % columns * cell.width, origin.y + i / columns * cell.height);
+        ImVec2 end(start.x + cell.width, start.y + cell.height);
+        draw_list->AddText(ImVec2(start.x + 5, start.y + 5), IM_COL32(255, 255, 255, 255), tiles[i].name.c_str());
+        if (tiles[i].name == focused)
+        {
+            draw_list->AddRect(start, end, IM_COL32(255, 255, 0, 255), 0, 0, 3);
+        }
+    }
+
+    if (ImGui::IsWindowHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+    {
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+        size_t tile_id = (int)((mouse.y - origin.y) / cell.height) * columns + (int)((mouse.x - origin.x) / cell.width);
+        if (tile_id < tiles.size() && tiles[tile_id].name != focused)
+        {
+            focus(tiles[tile_id].name);
+        }
+    }
+    ImGui::End();
+
+    if (focused_window)
+    {
+        bool open = true;
+        focused_window->display(&open);
+        if (!open)
+        {
+            focus("");
+        }
+    }
+}
+
+StreamWall::~StreamWall()
+{
+    if (atlas != 0)
+    {
+        glDeleteTextures(1, &atlas);
+    }
+    if (pbos[0] != 0)
+    {
+        glDeleteBuffers(PBO_COUNT, pbos);
+    }
+}
+
+}; // namespace farshow
@@ -0,0 +1,253 @@
+#include "farshow/streamexception.hpp"
+#include "farshow/udpinterface.hpp"
+
+#include "cxxopts/cxxopts.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/**
+ * Compares the transports of UdpInterface, sending datagrams over the loopback interface.
+ *
+ * Frames aren't encoded nor decoded, so only the cost of passing datagrams to and from the kernel is measured.
+ */
+
+/**
+ * Configuration of current program execution
+ */
+typedef struct Config
+{
+    int port;           ///< port used for the next run
+    unsigned count;     ///< number of datagrams sent in each run
+    unsigned size;      ///< size of a datagram
+    int receive_buffer; ///< receive buffer size of the receiving socket
+} Config;
+
+/**
+ * Result of one run
+ */
+typedef struct Result
+{
+    double send_rate;    ///< datagrams sent per second
+    double receive_rate; ///< datagrams received per second
+    unsigned received;   ///< number of received datagrams
+} Result;
+
+/**
+ * Receives datagrams and counts them
+ */
+class BenchmarkReceiver : public farshow::UdpInterface
+{
+public:
+    /**
+     * Creates and binds the socket
+     *
+     * @param port Port to bind to
+     * @param receive_buffer Receive buffer size of the socket
+     */
+    BenchmarkReceiver(int port, int receive_buffer) : UdpInterface("127.0.0.1", port)
+    {
+        setsockopt(mySocket, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+        if (bind(mySocket, (struct sockaddr *)&clientAddr, sizeof(clientAddr)) == -1)
+        {
+            throw farshow::StreamException("Cannot bind", errno);
+        }
+    }
+
+    /**
+     * Receives datagrams until the socket is shut down
+     */
+    void run()
+    {
+        const char *data;
+        while (receiveDatagram(data) > 0)
+        {
+            if (received++ == 0)
+            {
+                first = std::chrono::steady_clock::now();
+            }
+            last = std::chrono::steady_clock::now();
+        }
+    }
+
+    /**
+     * Shuts the socket down, which stops `run`
+     */
+    void stop() { shutdown(mySocket, SHUT_RDWR); }
+
+    unsigned received = 0;                       ///< number of received datagrams
+    std::chrono::steady_clock::time_point first; ///< time of the first received datagram
+    std::chrono::steady_clock::time_point last;  ///< time of the last received datagram
+};
+
+/**
+ * Sends datagrams as fast as possible
+ */
+class BenchmarkSender : public farshow::UdpInterface
+{
+public:
+    /**
+     * Creates the socket
+     *
+     * @param port Port of the receiver
+     */
+    BenchmarkSender(int port) : UdpInterface("127.0.0.1", port) {}
+
+    /**
+     * Sends the datagrams
+     *
+     * @param count Number of datagrams
+     * @param size Size of a datagram
+     */
+    void run(unsigned count, unsigned size)
+    {
+        std::vector<char> datagram(size, 'x');
+        for (unsigned i = 0; i < count; i++)
+        {
+            sendDatagram(datagram.data(), datagram.size());
+        }
+        flushDatagrams();
+    }
+};
+
+/**
+ * Sends datagrams from one transport to another and measures the rates
+ *
+ * @param config Benchmark configuration
+ * @param send_transport Transport of the sender
+ * @param receive_transport Transport of the receiver
+ *
+ * @returns Measured rates
+ */
+Result runBenchmark(Config &config, farshow::Transport send_transport, farshow::Transport receive_transport)
+{
+    // Every run uses a new port, because a closed io_uring may hold the previous socket for a moment
+    int port = config.port++;
+    BenchmarkReceiver receiver(port, config.receive_buffer);
+    BenchmarkSender sender(port);
+    if (receiver.setTransport(receive_transport) != receive_transport ||
+        sender.setTransport(send_transport) != send_transport)
+    {
+        throw farshow::StreamException("io_uring is not available");
+    }
+
+    std::thread receiving([&receiver]() { receiver.run(); });
+
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        sender.run(config.count, config.size);
+    }
+    catch (...)
+    {
+        // A joinable thread would terminate the program before the error is printed
+        receiver.stop();
+        receiving.join();
+        throw;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // Let the receiver drain its buffer
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    receiver.stop();
+    receiving.join();
+
+    Result result;
+    result.send_rate = config.count / std::chrono::duration<double>(end - start).count();
+    result.receive_rate = receiver.received > 1
+                              ? receiver.received / std::chrono::duration<double>(receiver.last - receiver.first).count()
+                              : 0;
+    result.received = receiver.received;
+    return result;
+}
+
+//------------------ COMMAND LINE OPTIONS ----------------------
+
+/**
+ * Parses command line options
+ *
+ * @param argc Arguments counter
+ * @param argv Arguments values
+ *
+ * @returns Parsed configuration
+ */
+Config parseOptions(int argc, char const *argv[])
+{
+    Config config;
+    cxxopts::ParseResult result;
+
+    cxxopts::Options options("Farshow transport benchmark",
+                             "Compares plain socket and io_uring transports, sending datagrams over the loopback "
+                             "interface.");
+
+    // clang-format off
+    options.add_options()
+        ("p, port", "First port used for the benchmark (each run uses the next one)",
+                cxxopts::value(config.port)->default_value("1100"))
+        ("n, count", "Number of datagrams sent in each run", cxxopts::value(config.count)->default_value("1000000"))
+        ("s, size", "Size of a datagram in bytes", cxxopts::value(config.size)->default_value("1024"))
+        ("b, receive-buffer", "Receive buffer size of the receiving socket in bytes",
+                cxxopts::value(config.receive_buffer)->default_value("4194304"))
+        ("h, help", "Print usage");
+    // clang-format on
+
+    try
+    {
+        result = options.parse(argc, argv);
+    }
+    catch (cxxopts::OptionException &e)
+    {
+        std::cerr << std::endl
+                  << "\033[31mError while parsing command line arguments: " << e.what() << "\033[0m" << std::endl
+                  << std::endl;
+        std::cout << options.help() << std::endl;
+        exit(1);
+    }
+
+    if (result.count("help"))
+    {
+        std::cout << options.help() << std::endl;
+        exit(0);
+    }
+
+    if (config.size == 0 || config.size > DATAGRAM_SIZE)
+    {
+        std::cerr << "\033[31mDatagram size has to be between 1 and " << DATAGRAM_SIZE << "\033[0m"
+                  << std::endl;
+        exit(1);
+    }
+
+    return config;
+}
+
+int main(int argc, const char **argv)
+{
+    Config config = parseOptions(argc, argv);
+
+    std::vector<std::pair<std::string, farshow::Transport>> transports = {{"socket", farshow::Transport::SOCKET},
+                                                                          {"io_uring", farshow::Transport::IO_URING}};
+
+    std::cout << config.count << " datagrams of " << config.size << " bytes" << std::endl;
+    std::cout << std::left << std::setw(10) << "sender" << std::setw(10) << "receiver" << std::right << std::setw(16)
+              << "sent [dgram/s]" << std::setw(20) << "received [dgram/s]" << std::setw(12) << "lost" << std::endl;
+    for (auto &send_transport : transports)
+    {
+        for (auto &receive_transport : transports)
+        {
+            std::cout << std::left << std::setw(10) << send_transport.first << std::setw(10)
+                      << receive_transport.first << std::right << std::flush;
+            try
+            {
+                Result result = runBenchmark(config, send_transport.second, receive_transport.second);
+                std::cout << std::fixed << std::setprecision(0) << std::setw(16) << result.send_rate << std::setw(20)
+                          << result.receive_rate << std::setw(12) << config.count - result.received << std::endl;
+            }
+            catch (farshow::StreamException &e)
+            {
+                std::cout << "  " << e.what() << std::endl;
+            }
+        }
+    }
+}
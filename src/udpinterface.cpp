@@ -1,6 +1,10 @@
 #include "farshow/udpinterface.hpp"
+#include "farshow/iouring.hpp"
 #include "farshow/streamexception.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
 #include <unistd.h>
 
 namespace farshow
@@ -21,6 +25,152 @@ UdpInterface::UdpInterface(std::string client_ip, int client_port)
     }
 }
 
-UdpInterface::~UdpInterface() { close(mySocket); }
+UdpInterface::~UdpInterface()
+{
+    uring.reset(); // Before closing the socket used by it
+    close(mySocket);
+}
+
+Transport UdpInterface::setTransport(Transport requested)
+{
+    uring.reset();
+    transport = Transport::SOCKET;
+    if (requested == Transport::IO_URING)
+    {
+        try
+        {
+            uring = std::make_unique<IoUringTransport>(mySocket, clientAddr);
+            transport = Transport::IO_URING;
+        }
+        catch (StreamException &)
+        {
+            // Fall back to plain sockets
+        }
+    }
+    return transport;
+}
+
+size_t UdpInterface::receiveDatagram(const char *&data)
+{
+    return *receiveDatagram(data, std::chrono::steady_clock::time_point::max());
+}
+
+std::optional<size_t> UdpInterface::receiveDatagram(const char *&data, std::chrono::steady_clock::time_point deadline)
+{
+    if (transport == Transport::IO_URING)
+    {
+        struct msghdr msg = {};
+        long res = uring->receive(data, msg, deadline);
+        if (res >= 0)
+        {
+            readControl(msg);
+            return res;
+        }
+        if (res == -ETIME)
+        {
+            return std::nullopt;
+        }
+        if (res != -EINVAL)
+        {
+            throw StreamException("Cannot receive message", -res);
+        }
+        // The kernel doesn't support multishot recvmsg, fall back to plain sockets
+        uring.reset();
+        transport = Transport::SOCKET;
+    }
+
+    if (deadline != std::chrono::steady_clock::time_point::max())
+    {
+        struct pollfd waited = {mySocket, POLLIN, 0};
+        int res;
+        do
+        {
+            // Rounded up, so the wait doesn't end just before the deadline
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            res = poll(&waited, 1, std::max<long>(left.count(), 0));
+        } while (res < 0 && errno == EINTR);
+        if (res < 0)
+        {
+            throw StreamException("Cannot receive message", errno);
+        }
+        if (res == 0)
+        {
+            return std::nullopt;
+        }
+    }
+
+    if (!datagram)
+    {
+        datagram = std::make_unique<FrameMessage>();
+    }
+    struct iovec iov = {datagram.get(), sizeof(FrameMessage)};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int res = recvmsg(mySocket, &msg, 0);
+    if (res < 0)
+    {
+        throw StreamException("Cannot receive message", errno);
+    }
+    readControl(msg);
+    data = (const char *)datagram.get();
+    return res;
+}
+
+void UdpInterface::readControl(const struct msghdr &msg)
+{
+    bool timestamped = false;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR((struct msghdr *)&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            struct timespec time;
+            memcpy(&time, CMSG_DATA(cmsg), sizeof(time));
+            receive_time = fromWireTime(time.tv_sec * 1000000000ull + time.tv_nsec);
+            timestamped = true;
+        }
+        else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            // Sent only when any datagram was dropped
+            memcpy(&dropped_datagrams, CMSG_DATA(cmsg), sizeof(dropped_datagrams));
+        }
+    }
+    if (!timestamped)
+    {
+        receive_time = std::chrono::system_clock::now();
+    }
+}
+
+void UdpInterface::sendDatagram(const void *data, size_t size)
+{
+    if (transport == Transport::IO_URING)
+    {
+        int res = uring->send(data, size);
+        if (res < 0)
+        {
+            throw StreamException("Cannot send", -res);
+        }
+        return;
+    }
+
+    if (sendto(mySocket, data, size, 0, (const struct sockaddr *)&clientAddr, sizeof(clientAddr)) < 0)
+    {
+        throw StreamException("Cannot send", errno);
+    }
+}
+
+void UdpInterface::flushDatagrams()
+{
+    if (transport == Transport::IO_URING)
+    {
+        int res = uring->flush();
+        if (res < 0)
+        {
+            throw StreamException("Cannot send", -res);
+        }
+    }
+}
 
 }; // namespace farshow